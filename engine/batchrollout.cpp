@@ -0,0 +1,176 @@
+#include "batchrollout.hpp"
+#include "eval.hpp"
+
+// A one square step and the squares it may land on without having wrapped around the board
+struct Step {
+	int delta;
+	Bitboard mask;
+};
+
+constexpr Bitboard NOT_A = ~FileABits, NOT_H = ~FileHBits, NOT_AB = ~(FileABits | FileBBits), NOT_GH = ~(FileGBits | FileHBits);
+
+// Rook directions first, then bishop directions
+constexpr Step RAYS[8] = {{8, ~0ULL}, {-8, ~0ULL}, {1, NOT_A}, {-1, NOT_H}, {9, NOT_A}, {7, NOT_H}, {-7, NOT_A}, {-9, NOT_H}};
+constexpr Step JUMPS[8] = {{17, NOT_A}, {15, NOT_H}, {10, NOT_AB}, {6, NOT_GH}, {-6, NOT_AB}, {-10, NOT_GH}, {-15, NOT_A}, {-17, NOT_H}};
+// Pushes, double pushes and both captures, for white and black
+constexpr Step PAWN_STEPS[2][4] = {{{8, ~0ULL}, {16, ~0ULL}, {7, NOT_H}, {9, NOT_A}}, {{-8, ~0ULL}, {-16, ~0ULL}, {-9, NOT_H}, {-7, NOT_A}}};
+
+// Every pseudo-legal move is identified by the generator that produced it and its destination
+// Generators are the 8 slider rays, 8 knight jumps, 8 king steps and 4 pawn moves
+constexpr int RAY_GENS = 0, JUMP_GENS = 8, KING_GENS = 16, PAWN_GENS = 24, NGENS = 28;
+
+static inline LaneBoards shift(LaneBoards b, const Step &s) {
+	return (s.delta > 0 ? b << s.delta : b >> -s.delta) & s.mask;
+}
+
+static inline LaneBoards shift(LaneBoards b, int delta) {
+	return delta > 0 ? b << delta : b >> -delta;
+}
+
+// Squares attacked along a ray by the sliders in gen, with a Kogge-Stone fill through the empty squares
+static inline LaneBoards ray_attacks(LaneBoards gen, LaneBoards empty, const Step &s) {
+	LaneBoards pro = empty & s.mask;
+	gen |= pro & shift(gen, s.delta);
+	pro &= shift(pro, s.delta);
+	gen |= pro & shift(gen, 2 * s.delta);
+	pro &= shift(pro, 2 * s.delta);
+	gen |= pro & shift(gen, 4 * s.delta);
+	return shift(gen, s);
+}
+
+// SWAR population count of every lane
+static inline LaneBoards popcount(LaneBoards x) {
+	x -= (x >> 1) & 0x5555555555555555ULL;
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (x * 0x0101010101010101ULL) >> 56;
+}
+
+void BatchBoards::load(const Board &board, fast_random &seed) {
+	for (int i = 0; i < 8; i++)
+		pieces[i] = LaneBoards{} + board.piece_boards[i];
+	for (int lane = 0; lane < BATCH_LANES; lane++)
+		rng[lane] = seed.next() | 1;
+	side = board.side;
+	active = (1 << BATCH_LANES) - 1;
+}
+
+void BatchBoards::step(double *result) {
+	const LaneBoards own = pieces[OCC(side)], them = pieces[OCC(!side)];
+	const LaneBoards empty = ~(own | them), targets = ~own;
+
+	LaneBoards gens[NGENS];
+	const LaneBoards orth = (pieces[ROOK] | pieces[QUEEN]) & own, diag = (pieces[BISHOP] | pieces[QUEEN]) & own;
+	for (int d = 0; d < 8; d++)
+		gens[RAY_GENS + d] = ray_attacks(d < 4 ? orth : diag, empty, RAYS[d]) & targets;
+	for (int d = 0; d < 8; d++) {
+		gens[JUMP_GENS + d] = shift(pieces[KNIGHT] & own, JUMPS[d]) & targets;
+		gens[KING_GENS + d] = shift(pieces[KING] & own, RAYS[d]) & targets;
+	}
+	const LaneBoards pawns = pieces[PAWN] & own;
+	const Step *ps = PAWN_STEPS[side];
+	gens[PAWN_GENS] = shift(pawns, ps[0]) & empty;
+	const Bitboard third = side == WHITE ? Rank3Bits : Rank6Bits;
+	gens[PAWN_GENS + 1] = shift(gens[PAWN_GENS] & third, ps[0]) & empty;
+	gens[PAWN_GENS + 2] = shift(pawns, ps[2]) & them;
+	gens[PAWN_GENS + 3] = shift(pawns, ps[3]) & them;
+
+	// Move counts per generator and a uniform pick among all of them, in every lane at once
+	LaneBoards counts[NGENS], total = {};
+	for (int g = 0; g < NGENS; g++) {
+		counts[g] = popcount(gens[g]);
+		total += counts[g];
+	}
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	LaneBoards pick = (((rng * 0x2545F4914F6C21C6ULL) >> 32) * total) >> 32;
+	// Walk the generators, each lane keeps the first one its pick falls into and the pick's index within it
+	LaneBoards chosen_gen = {}, chosen_bb = {}, found = {};
+	for (int g = 0; g < NGENS; g++) {
+		const LaneBoards hit = (LaneBoards)(pick < counts[g]) & ~found;
+		chosen_gen |= hit & (Bitboard)g;
+		chosen_bb |= hit & gens[g];
+		found |= hit;
+		pick -= counts[g] & ~found;
+	}
+
+	for (int lane = 0; lane < BATCH_LANES; lane++) {
+		if (!(active >> lane & 1))
+			continue;
+		if (total[lane] == 0) {
+			result[lane] = 0;
+			active &= ~(1 << lane);
+			continue;
+		}
+		// There is no vector pdep, so the square itself is found lane by lane
+		const int to = _tzcnt_u64(_pdep_u64(1ULL << pick[lane], chosen_bb[lane]));
+		const int g = chosen_gen[lane];
+		int from;
+		if (g < JUMP_GENS) {
+			// Back along the ray to the slider that made the move
+			const Bitboard sliders = (g < 4 ? orth : diag)[lane];
+			from = to - RAYS[g].delta;
+			while (!(sliders >> from & 1))
+				from -= RAYS[g].delta;
+		} else if (g < KING_GENS) {
+			from = to - JUMPS[g - JUMP_GENS].delta;
+		} else if (g < PAWN_GENS) {
+			from = to - RAYS[g - KING_GENS].delta;
+		} else {
+			from = to - ps[g - PAWN_GENS].delta;
+		}
+
+		const Bitboard from_bb = 1ULL << from, to_bb = 1ULL << to;
+		if (them[lane] & to_bb) {
+			if (pieces[KING][lane] & to_bb) {
+				result[lane] = 1;
+				active &= ~(1 << lane);
+				continue;
+			}
+			for (int pt = PAWN; pt < KING; pt++)
+				pieces[pt][lane] &= ~to_bb;
+			pieces[OCC(!side)][lane] &= ~to_bb;
+		}
+		int moved = PAWN;
+		while (!(pieces[moved][lane] & from_bb))
+			moved++;
+		pieces[moved][lane] &= ~from_bb;
+		pieces[moved == PAWN && (to_bb & (Rank1Bits | Rank8Bits)) ? QUEEN : moved][lane] |= to_bb;
+		pieces[OCC(side)][lane] ^= from_bb | to_bb;
+	}
+	side = !side;
+}
+
+void batch_rollout(const Board &board, int plies, fast_random &rng, double *scores, uint64_t &plies_played) {
+	BatchBoards batch;
+	batch.load(board, rng);
+	double result[BATCH_LANES];
+	for (int ply = 0; ply < plies && batch.active; ply++) {
+		const uint8_t before = batch.active;
+		batch.step(result);
+		for (int lane = 0; lane < BATCH_LANES; lane++) {
+			if (before >> lane & 1)
+				plies_played++;
+			// The side to move on board is the one that moved on even plies
+			if ((before & ~batch.active) >> lane & 1)
+				scores[lane] = ply & 1 ? -result[lane] : result[lane];
+		}
+	}
+	if (!batch.active)
+		return;
+
+	Bitboard positions[BATCH_LANES][8];
+	int lanes[BATCH_LANES], n = 0;
+	for (int lane = 0; lane < BATCH_LANES; lane++) {
+		if (!(batch.active >> lane & 1))
+			continue;
+		for (int i = 0; i < 8; i++)
+			positions[n][i] = batch.pieces[i][lane];
+		lanes[n++] = lane;
+	}
+	double evals[BATCH_LANES];
+	eval_positions(positions, n, batch.side, evals);
+	for (int i = 0; i < n; i++)
+		scores[lanes[i]] = board.side == WHITE ? evals[i] : -evals[i];
+}
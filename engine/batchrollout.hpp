@@ -0,0 +1,35 @@
+#pragma once
+
+#include "includes.hpp"
+
+#include "bitboard.hpp"
+#include "random.hpp"
+
+// Rollouts advanced in lock-step, one per 64 bit element of the widest vector register
+#ifdef __AVX512F__
+#define BATCH_LANES 8
+#else
+#define BATCH_LANES 4
+#endif
+
+// One bitboard per lane, the vector operators compile to AVX2 or AVX-512 instructions
+typedef Bitboard LaneBoards __attribute__((vector_size(BATCH_LANES * sizeof(Bitboard))));
+
+// Bitboard only positions of BATCH_LANES rollouts with a common start
+// Moves are pseudo-legal, without castling or en passant, promotions are always to a queen and a lane ends when a king is taken
+struct BatchBoards {
+	LaneBoards pieces[8]; // Same layout as Board::piece_boards
+	LaneBoards rng; // Per lane xorshift state
+	bool side; // Every lane has made the same number of moves, so they share the side to move
+	uint8_t active; // Mask of the lanes still playing
+
+	void load(const Board &board, fast_random &seed);
+
+	// Plays one random move in every active lane
+	// Lanes that take a king or have no move drop out, with result set to 1 or 0 for the side that was to move
+	void step(double *result);
+};
+
+// Plays BATCH_LANES random rollouts of up to plies plies from board, then evaluates the lanes still going in one batch
+// Scores are from the perspective of the side to move on board, as with simulate(), plies_played gets the total length
+void batch_rollout(const Board &board, int plies, fast_random &rng, double *scores, uint64_t &plies_played);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "includes.hpp"
+
+#include <vector>
+
+// Nodes searched per position when `bench` is not given a count
+constexpr int64_t BENCH_NODES = 2500;
+
+// The bench positions, also the corpus of the microbenchmarks
+extern const char *const BENCH_FENS[];
+extern const int NBENCH_FENS;
+
+// Runs a fixed node search of every bench position twice per entry of thread_counts, deterministic and on the default path
+// Prints one `key value` line per position and run, then the `<nodes> nodes <nps> nps` line of the default path the usual bench tooling reads
+// Returns whether every run ended with the same signature, as deterministic searches must for any thread count
+bool bench(int64_t nodes, const std::vector<int> &thread_counts);
@@ -178,6 +178,7 @@ void Board::load_fen(std::string fen) {
 
 	// Recompute hash
 	recompute_hash();
+	recompute_material();
 }
 
 std::string Board::get_fen() const {
@@ -393,6 +394,8 @@ void Board::make_move(Move move) {
 		piece_boards[piece] ^= square_bits(move.dst());
 		piece_boards[OPPOCC(side)] ^= square_bits(move.dst());
 		zobrist ^= zobrist_square[move.dst()][mailbox[move.dst()]];
+		piece_counts[mailbox[move.dst()]]--;
+		material[!side] -= PieceValue[piece];
 
 		if (piece == ROOK) {
 			uint8_t old_castling = castling;
@@ -421,6 +424,9 @@ void Board::make_move(Move move) {
 		mailbox[move.src()] = NO_PIECE;
 		mailbox[move.dst()] = Piece(move.promotion() + ((!!side) << 3) + KNIGHT);
 		zobrist ^= zobrist_square[move.dst()][mailbox[move.dst()]];
+		piece_counts[PAWN + ((!!side) << 3)]--;
+		piece_counts[mailbox[move.dst()]]++;
+		material[side] += PieceValue[move.promotion() + KNIGHT] - PawnValue;
 		piece_boards[PAWN] ^= square_bits(move.src());
 		piece_boards[OCC(side)] ^= square_bits(move.src()) | square_bits(move.dst());
 		piece_boards[move.promotion() + KNIGHT] ^= square_bits(move.dst());
@@ -431,6 +437,8 @@ void Board::make_move(Move move) {
 		mailbox[move.dst()] = mailbox[move.src()];
 		mailbox[move.src()] = NO_PIECE;
 		mailbox[(move.src() & 0b111000) | (move.dst() & 0b111)] = NO_PIECE;
+		piece_counts[PAWN + ((!side) << 3)]--;
+		material[!side] -= PawnValue;
 		piece_boards[PAWN] ^= square_bits(move.src()) | square_bits(move.dst()) | square_bits(Rank(move.src() >> 3), File(move.dst() & 0b111));
 		piece_boards[OCC(side)] ^= square_bits(move.src()) | square_bits(move.dst());
 		piece_boards[OPPOCC(side)] ^= square_bits(Rank(move.src() >> 3), File(move.dst() & 0b111));
@@ -594,6 +602,9 @@ void Board::unmake_move() {
 	} else if (move.type() == PROMOTION) {
 		// Remove the piece on the dst and add the pawn on the src
 		zobrist ^= zobrist_square[move.dst()][mailbox[move.dst()]] ^ zobrist_square[move.dst()][prev.prev_piece()];
+		piece_counts[mailbox[move.dst()]]--;
+		piece_counts[PAWN + ((!!side) << 3)]++;
+		material[side] -= PieceValue[move.promotion() + KNIGHT] - PawnValue;
 		mailbox[move.src()] = Piece(PAWN + ((!!side) << 3));
 		mailbox[move.dst()] = prev.prev_piece();
 		zobrist ^= zobrist_square[move.src()][mailbox[move.src()]];
@@ -606,6 +617,8 @@ void Board::unmake_move() {
 			uint8_t piece = prev.prev_piece() & 0b111;
 			piece_boards[piece] ^= square_bits(move.dst());
 			piece_boards[OPPOCC(side)] ^= square_bits(move.dst());
+			piece_counts[prev.prev_piece()]++;
+			material[!side] += PieceValue[piece];
 		}
 	} else if (move.type() == EN_PASSANT) {
 		// Remove the pawn on the dst and add the pawn on the src and the taken pawn
@@ -613,6 +626,8 @@ void Board::unmake_move() {
 		mailbox[move.src()] = mailbox[move.dst()];
 		mailbox[move.dst()] = NO_PIECE;
 		mailbox[(move.src() & 0b111000) | (move.dst() & 0b111)] = Piece(WHITE_PAWN + ((!side) << 3));
+		piece_counts[WHITE_PAWN + ((!side) << 3)]++;
+		material[!side] += PawnValue;
 		zobrist ^= zobrist_square[(move.src() & 0b111000) | (move.dst() & 0b111)][mailbox[(move.src() & 0b111000) | (move.dst() & 0b111)]]; // Taken pawn
 		piece_boards[PAWN] ^= square_bits(move.src()) | square_bits(move.dst()) | square_bits(Rank(move.src() >> 3), File(move.dst() & 0b111));
 		piece_boards[OCC(side)] ^= square_bits(move.src()) | square_bits(move.dst());
@@ -684,6 +699,8 @@ void Board::unmake_move() {
 			piece = prev.prev_piece() & 0b111;
 			piece_boards[piece] ^= square_bits(move.dst());
 			piece_boards[OPPOCC(side)] ^= square_bits(move.dst());
+			piece_counts[prev.prev_piece()]++;
+			material[!side] += PieceValue[piece];
 		}
 	}
 
@@ -745,6 +762,31 @@ void Board::recompute_hash() {
 	zobrist ^= zobrist_side * side;
 }
 
+void Board::recompute_material() {
+	memset(piece_counts, 0, sizeof(piece_counts));
+	material[WHITE] = material[BLACK] = 0;
+	for (int i = 0; i < 64; i++) {
+		if (mailbox[i] == NO_PIECE)
+			continue;
+		piece_counts[mailbox[i]]++;
+		if ((mailbox[i] & 7) != KING)
+			material[mailbox[i] >> 3] += PieceValue[mailbox[i] & 7];
+	}
+}
+
+bool Board::insufficient_material() const {
+	for (int c = 0; c < 2; c++) {
+		const int base = c << 3;
+		if (piece_counts[base + PAWN] || piece_counts[base + ROOK] || piece_counts[base + QUEEN])
+			return false;
+		// A lone minor or two knights cannot force mate
+		const int minors = piece_counts[base + KNIGHT] + piece_counts[base + BISHOP];
+		if (minors > 2 || (minors == 2 && piece_counts[base + BISHOP]))
+			return false;
+	}
+	return true;
+}
+
 bool Board::threefold() {
 	int cnt = 0;
 	for (const uint64_t h : hash_hist) {
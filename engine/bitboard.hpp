@@ -77,6 +77,10 @@ struct Board {
 							BLACK_PAWN, BLACK_PAWN,	  BLACK_PAWN,	BLACK_PAWN,	 BLACK_PAWN, BLACK_PAWN,   BLACK_PAWN,	 BLACK_PAWN,
 							BLACK_ROOK, BLACK_KNIGHT, BLACK_BISHOP, BLACK_QUEEN, BLACK_KING, BLACK_BISHOP, BLACK_KNIGHT, BLACK_ROOK};
 
+	// Piece counts indexed by Piece and material (excluding kings) per side, kept up to date by make/unmake
+	uint8_t piece_counts[NO_PIECE + 1] = {0};
+	Value material[2] = {0};
+
 	// Moves with extra information (taken piece etc..)
 	// better documentation will be included later
 	std::stack<HistoryEntry> move_hist;
@@ -93,6 +97,7 @@ struct Board {
 		piece_boards[6] = Rank1Bits | Rank2Bits;
 		piece_boards[7] = Rank7Bits | Rank8Bits;
 		recompute_hash();
+		recompute_material();
 	}
 
 	Board(std::string fen) {
@@ -114,6 +119,9 @@ struct Board {
 	Value see_capture(Move);
 
 	void recompute_hash();
+	void recompute_material();
+	// Neither side can possibly mate
+	bool insufficient_material() const;
 
 	bool threefold();
 	uint8_t ended(pzstd::vector<Move> &, pzstd::vector<Move> &);
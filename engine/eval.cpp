@@ -1,29 +1,194 @@
 #include "eval.hpp"
 
-Network nn_network;
+// This function is called before main()
+__attribute__((constructor)) void init_network() {
+	load_embedded_network();
+}
 
-double eval(Board &board) {
-	Accumulator w_acc, b_acc;
-	// Query the NNUE network
-	for (uint16_t i = 0; i < 64; i++) {
-		Piece piece = board.mailbox[i];
-		bool side = piece >> 3; // 1 = black, 0 = white
-		PieceType pt = PieceType(piece & 7);
-		
-		accumulator_add(nn_network, w_acc, calculate_index((Square)i, pt, side, true));
-		accumulator_sub(nn_network, b_acc, calculate_index((Square)i, pt, side, false));
+template <typename Net>
+static void refresh_accumulators(const Net &net, const Bitboard *piece_boards, typename Net::Accumulator &w_acc, typename Net::Accumulator &b_acc) {
+	// Collect the active features by scanning the piece bitboards, so empty squares cost nothing
+	uint16_t w_idx[MAX_ACTIVE], b_idx[MAX_ACTIVE];
+	int n = 0;
+	for (int side = WHITE; side <= BLACK; side++) {
+		for (int pt = PAWN; pt <= KING; pt++) {
+			// Same layout as calculate_index(), hoisted out of the square loop
+			const uint16_t w_base = side * 64 * 6 + pt * 64;
+			const uint16_t b_base = !side * 64 * 6 + pt * 64;
+			Bitboard pieces = piece_boards[pt] & piece_boards[OCC(side)];
+			while (pieces) {
+				uint16_t sq = _tzcnt_u64(pieces);
+				w_idx[n] = w_base + sq;
+				b_idx[n] = b_base + (sq ^ 56);
+				n++;
+				pieces = _blsr_u64(pieces);
+			}
+		}
+	}
+
+	accumulator_refresh(net, w_acc, b_acc, w_idx, b_idx, n);
+}
+
+template <typename Net>
+static void refresh_accumulators(const Net &net, const Board &board, typename Net::Accumulator &w_acc, typename Net::Accumulator &b_acc) {
+	refresh_accumulators(net, board.piece_boards, w_acc, b_acc);
+}
+
+// Feature changes caused by a move, for both perspectives
+struct FeatureDelta {
+	uint16_t w_add[2], b_add[2], w_sub[2], b_sub[2];
+	int nadd = 0, nsub = 0;
+
+	void add(Square sq, PieceType pt, bool side) {
+		w_add[nadd] = calculate_index(sq, pt, side, WHITE);
+		b_add[nadd++] = calculate_index(sq, pt, side, BLACK);
+	}
+	void sub(Square sq, PieceType pt, bool side) {
+		w_sub[nsub] = calculate_index(sq, pt, side, WHITE);
+		b_sub[nsub++] = calculate_index(sq, pt, side, BLACK);
+	}
+};
+
+// Computes the delta of a move without playing it, must be called with the board before the move
+static FeatureDelta move_delta(const Board &board, Move move) {
+	FeatureDelta delta;
+	const bool side = board.side;
+	const PieceType moving = PieceType(board.mailbox[move.src()] & 7);
+
+	if (move.type() == CASTLING) {
+		// The king jumps two squares, the rook lands on the square it crossed
+		const bool kingside = move.dst() > move.src();
+		const Square rook_src = Square(kingside ? move.dst() + 1 : move.dst() - 2);
+		const Square rook_dst = Square(kingside ? move.dst() - 1 : move.dst() + 1);
+		delta.sub(move.src(), KING, side);
+		delta.add(move.dst(), KING, side);
+		delta.sub(rook_src, ROOK, side);
+		delta.add(rook_dst, ROOK, side);
+		return delta;
+	}
+
+	delta.sub(move.src(), moving, side);
+	delta.add(move.dst(), move.type() == PROMOTION ? PieceType(move.promotion() + KNIGHT) : moving, side);
+	if (move.type() == EN_PASSANT)
+		delta.sub(Square((move.src() & 0b111000) | (move.dst() & 0b111)), PAWN, !side);
+	else if (board.mailbox[move.dst()] != NO_PIECE)
+		delta.sub(move.dst(), PieceType(board.mailbox[move.dst()] & 7), !side);
+	return delta;
+}
+
+uint16_t policy_index(Move move, bool side) {
+	// Black's moves are mirrored so both sides share the same rows
+	const int flip = side == BLACK ? 56 : 0;
+	const int src = move.src() ^ flip, dst = move.dst() ^ flip;
+	if (move.type() == PROMOTION && move.promotion() != QUEEN - KNIGHT)
+		return 64 * 64 + ((src & 7) * 8 + (dst & 7)) * 3 + move.promotion();
+	return src * 64 + dst;
+}
+
+template <typename Net>
+static bool eval_children_with(const Net &net, const Board &board, const pzstd::vector<Move> &moves, int32_t *scores, float *logits) {
+	const bool policy = logits && nn_policy;
+	if (!policy && !scores)
+		return false;
+	typename Net::Accumulator w_acc, b_acc;
+	refresh_accumulators(net, board, w_acc, b_acc);
+
+	if (policy) {
+		uint16_t indices[PZSTL_MAX_SIZE];
+		for (int i = 0; i < moves.size(); i++)
+			indices[i] = policy_index(moves[i], board.side);
+		policy_logits(net, *(const PolicyHead<Net::HL_SIZE> *)nn_policy, board.side == WHITE ? w_acc : b_acc, indices, moves.size(), logits);
+	}
+	if (!scores)
+		return policy;
+
+	const int npieces = _mm_popcnt_u64(board.piece_boards[OCC(WHITE)] | board.piece_boards[OCC(BLACK)]);
+
+	// Children are processed in blocks so that their accumulators stay in L1
+	constexpr int BLOCK = 8;
+	typename Net::Accumulator w_child[BLOCK], b_child[BLOCK];
+	uint8_t nbuckets[BLOCK];
+	for (int b = 0; b < moves.size(); b += BLOCK) {
+		const int cnt = std::min(BLOCK, moves.size() - b);
+		for (int i = 0; i < cnt; i++) {
+			FeatureDelta delta = move_delta(board, moves[b + i]);
+			accumulator_update(net, w_acc, w_child[i], delta.w_add, delta.nadd, delta.w_sub, delta.nsub);
+			accumulator_update(net, b_acc, b_child[i], delta.b_add, delta.nadd, delta.b_sub, delta.nsub);
+			// Every removal beyond the moved piece itself is a capture
+			nbuckets[i] = output_bucket<Net>(npieces - (delta.nsub - delta.nadd));
+		}
+		// The opponent is to move in every child
+		if (board.side == WHITE)
+			nn_eval_batch(net, b_child, w_child, nbuckets, cnt, scores + b);
+		else
+			nn_eval_batch(net, w_child, b_child, nbuckets, cnt, scores + b);
+		// Report from the perspective of the side to move at the parent
+		for (int i = 0; i < cnt; i++)
+			scores[b + i] = -scores[b + i];
 	}
+	return policy;
+}
+
+bool eval_children(const Board &board, const pzstd::vector<Move> &moves, int32_t *scores, float *logits) {
+	return with_network([&](const auto &net) { return eval_children_with(net, board, moves, scores, logits); });
+}
+
+// Returns the raw network output from white's perspective
+template <typename Net>
+static int32_t eval_with(const Net &net, const Board &board) {
+	typename Net::Accumulator w_acc, b_acc;
+	// Query the NNUE network
+	refresh_accumulators(net, board, w_acc, b_acc);
 
 	int npieces = _mm_popcnt_u64(board.piece_boards[OCC(WHITE)] | board.piece_boards[OCC(BLACK)]);
-	int nbucket = (npieces - 2) / 4;
+	uint8_t nbucket = output_bucket<Net>(npieces);
 
 	int32_t score;
 	if (board.side == WHITE) {
-		score = nn_eval(nn_network, w_acc, b_acc, nbucket);
+		nn_eval_batch(net, &w_acc, &b_acc, &nbucket, 1, &score);
 	} else {
-		score = -nn_eval(nn_network, b_acc, w_acc, nbucket);
+		nn_eval_batch(net, &b_acc, &w_acc, &nbucket, 1, &score);
+		score = -score;
 	}
-	
+	return score;
+}
+
+double eval(Board &board) {
+	int16_t cached;
+	if (eval_cache.probe(board.zobrist, cached)) {
+		return (double)cached / 10000;
+	}
+
+	int32_t score = with_network([&](const auto &net) { return eval_with(net, board); });
+
 	// Bind score to [-1, 1]
-	return std::min(std::max((double)score / 10000, -1.0), 1.0);
-}
\ No newline at end of file
+	score = std::clamp(score, -10000, 10000);
+	eval_cache.store(board.zobrist, score);
+	return (double)score / 10000;
+}
+template <typename Net>
+static void eval_positions_with(const Net &net, const Bitboard (*positions)[8], int n, bool side, int32_t *scores) {
+	constexpr int BLOCK = 8;
+	typename Net::Accumulator w_acc[BLOCK], b_acc[BLOCK];
+	uint8_t nbuckets[BLOCK];
+	for (int b = 0; b < n; b += BLOCK) {
+		const int cnt = std::min(BLOCK, n - b);
+		for (int i = 0; i < cnt; i++) {
+			refresh_accumulators(net, positions[b + i], w_acc[i], b_acc[i]);
+			nbuckets[i] = output_bucket<Net>(_mm_popcnt_u64(positions[b + i][OCC(WHITE)] | positions[b + i][OCC(BLACK)]));
+		}
+		if (side == WHITE)
+			nn_eval_batch(net, w_acc, b_acc, nbuckets, cnt, scores + b);
+		else
+			nn_eval_batch(net, b_acc, w_acc, nbuckets, cnt, scores + b);
+	}
+}
+
+void eval_positions(const Bitboard (*positions)[8], int n, bool side, double *scores) {
+	int32_t raw[PZSTL_MAX_SIZE];
+	with_network([&](const auto &net) { eval_positions_with(net, positions, n, side, raw); });
+	for (int i = 0; i < n; i++) {
+		const int32_t score = std::clamp(side == WHITE ? raw[i] : -raw[i], -10000, 10000);
+		scores[i] = (double)score / 10000;
+	}
+}
@@ -2,6 +2,19 @@
 
 #include "includes.hpp"
 #include "bitboard.hpp"
+#include "evalcache.hpp"
 #include "nn/network.hpp"
 
-double eval(Board &board);
\ No newline at end of file
+// Evaluates every child of the position in one batch, reusing the parent's accumulators
+// Scores are raw network output from the perspective of the side to move in the parent
+// Either output may be null, logits are only written if the network has a policy head, which is what it returns
+bool eval_children(const Board &board, const pzstd::vector<Move> &moves, int32_t *scores, float *logits = nullptr);
+
+// Row of a move in the policy head
+uint16_t policy_index(Move move, bool side);
+
+double eval(Board &board);
+
+// Evaluates up to PZSTL_MAX_SIZE positions given only by their piece bitboards (Board::piece_boards layout), all with side to move
+// Scores are in the same units as eval(), but there is no hash to use the eval cache with
+void eval_positions(const Bitboard (*positions)[8], int n, bool side, double *scores);
\ No newline at end of file
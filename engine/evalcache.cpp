@@ -0,0 +1,67 @@
+#include "evalcache.hpp"
+
+EvalCache eval_cache;
+thread_local uint64_t EvalCache::local_hits = 0, EvalCache::local_probes = 0;
+
+// This function is called before main()
+__attribute__((constructor)) void init_evalcache() {
+	eval_cache.resize(16);
+}
+
+EvalCache::~EvalCache() {
+	delete[] buckets;
+}
+
+void EvalCache::resize(size_t mb) {
+	delete[] buckets;
+	buckets = nullptr;
+	mask = 0;
+	uint64_t nbuckets = (mb << 20) / sizeof(EvalCacheBucket);
+	if (nbuckets == 0)
+		return;
+	// Round down to a power of two so the index is a single mask
+	nbuckets = 1ULL << (63 - _lzcnt_u64(nbuckets));
+	buckets = new EvalCacheBucket[nbuckets];
+	mask = nbuckets - 1;
+	clear();
+}
+
+void EvalCache::clear() {
+	for (uint64_t i = 0; i <= mask && buckets; i++) {
+		for (auto &entry : buckets[i].entries) {
+			entry.store(0, std::memory_order_relaxed);
+		}
+	}
+	reset_stats();
+}
+
+bool EvalCache::probe(uint64_t key, int16_t &score) {
+	if (!buckets)
+		return false;
+	local_probes++;
+	EvalCacheBucket &bucket = buckets[key & mask];
+	for (auto &entry : bucket.entries) {
+		uint64_t data = entry.load(std::memory_order_relaxed);
+		if ((data ^ key) >> 16 == 0 && data) {
+			score = (int16_t)(data & 0xffff);
+			local_hits++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void EvalCache::store(uint64_t key, int16_t score) {
+	if (!buckets)
+		return;
+	EvalCacheBucket &bucket = buckets[key & mask];
+	// Fill an empty way if there is one, otherwise evict a way picked by key bits that are not part of the index
+	int way = (key >> 61) & (EVALCACHE_WAYS - 1);
+	for (int i = 0; i < EVALCACHE_WAYS; i++) {
+		if (bucket.entries[i].load(std::memory_order_relaxed) == 0) {
+			way = i;
+			break;
+		}
+	}
+	bucket.entries[way].store((key & ~0xffffULL) | (uint16_t)score, std::memory_order_relaxed);
+}
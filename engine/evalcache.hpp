@@ -0,0 +1,53 @@
+#pragma once
+
+#include "includes.hpp"
+
+#include <atomic>
+
+// Number of entries in a bucket, sized so that a bucket fills exactly one cache line
+#define EVALCACHE_WAYS 8
+
+// Each entry is a single 64 bit word, so reads and writes can never tear across threads
+// bits 0-15: score (int16_t)
+// bits 16-63: upper 48 bits of the zobrist key
+struct alignas(64) EvalCacheBucket {
+	std::atomic<uint64_t> entries[EVALCACHE_WAYS];
+};
+
+struct EvalCache {
+	EvalCacheBucket *buckets = nullptr;
+	uint64_t mask = 0;
+	// Totals merged from every thread's own counters by merge_stats(), probing itself never touches a shared line
+	std::atomic<uint64_t> hits{0}, probes{0};
+	static thread_local uint64_t local_hits, local_probes;
+
+	~EvalCache();
+
+	// Size is in MB, rounded down to a power of two number of buckets, 0 disables the cache
+	void resize(size_t mb);
+	void clear();
+
+	bool probe(uint64_t key, int16_t &score);
+	void store(uint64_t key, int16_t score);
+
+	// Clears the totals and the calling thread's counters
+	void reset_stats() {
+		hits.store(0, std::memory_order_relaxed);
+		probes.store(0, std::memory_order_relaxed);
+		local_hits = local_probes = 0;
+	}
+
+	// Adds the calling thread's counters to the totals, every thread that probed must call it before they are read
+	void merge_stats() {
+		hits.fetch_add(local_hits, std::memory_order_relaxed);
+		probes.fetch_add(local_probes, std::memory_order_relaxed);
+		local_hits = local_probes = 0;
+	}
+
+	inline void prefetch(uint64_t key) const {
+		if (buckets)
+			__builtin_prefetch(&buckets[key & mask]);
+	}
+};
+
+extern EvalCache eval_cache;
@@ -3,29 +3,57 @@
 #include <sstream>
 #include <thread>
 
+#include "bench.hpp"
 #include "bitboard.hpp"
 #include "movegen.hpp"
-#include "movetimings.hpp"
 #include "search.hpp"
 
 int main(int argc, char *argv[]) {
-	if (argc == 2 && std::string(argv[1]) == "bench") {
-		Board board = Board();
-		uint64_t start = clock();
-		search(board, 1000, 1);
-		uint64_t end = clock();
-		std::cout << 1 << " nodes " << (int)(ngames() / ((double)(end - start) / CLOCKS_PER_SEC)) << " nps" << std::endl;
-		return 0;
+	if (argc >= 2 && std::string(argv[1]) == "bench") {
+		// `bench [nodes per position] [thread count]...`
+		int64_t nodes = argc >= 3 ? std::stoll(argv[2]) : BENCH_NODES;
+		std::vector<int> thread_counts;
+		for (int i = 3; i < argc; i++)
+			thread_counts.push_back(std::stoi(argv[i]));
+		if (thread_counts.empty())
+			thread_counts.push_back(1);
+		return bench(nodes, thread_counts) ? 0 : 1;
 	}
 	bool online = argc == 2 && std::string(argv[1]) == "--online";
 	std::cout << "MonteCraplo " << VERSION << " developed by kevlu8 and wdotmathree" << std::endl;
 	std::string command;
 	Board board = Board();
 	std::thread searchthread;
+	// Options and the rollout tables are read by a running search, so anything that changes them stops it first
+	auto stop_and_join = [&]() {
+		if (searchthread.joinable()) {
+			stop_search();
+			searchthread.join();
+		}
+	};
 	while (getline(std::cin, command)) {
 		if (command == "uci") {
 			std::cout << "id name MonteCraplo " << VERSION << std::endl;
 			std::cout << "id author kevlu8 and wdotmathree" << std::endl;
+			std::cout << "option name Hash type spin default 64 min 1 max 65536" << std::endl;
+			std::cout << "option name Threads type spin default 1 min 1 max 256" << std::endl;
+			std::cout << "option name PipelineDepth type spin default 64 min 1 max 4096" << std::endl;
+			std::cout << "option name MultiPV type spin default 1 min 1 max 256" << std::endl;
+			std::cout << "option name InfoInterval type spin default 1000 min 1 max 60000" << std::endl;
+			std::cout << "option name Deterministic type check default false" << std::endl;
+			std::cout << "option name GumbelRoot type check default false" << std::endl;
+			std::cout << "option name RAVE type check default false" << std::endl;
+			std::cout << "option name ProgressiveWidening type check default true" << std::endl;
+			std::cout << "option name ValuePriors type check default true" << std::endl;
+			std::cout << "option name PolicyPriors type check default true" << std::endl;
+			std::cout << "option name RolloutMode type combo default Hybrid var Random var Hybrid var Batch" << std::endl;
+			std::cout << "option name RolloutPolicy type combo default Uniform var Uniform var MAST var NST" << std::endl;
+			std::cout << "option name Adjudication type check default true" << std::endl;
+			std::cout << "option name EvalCache type spin default 16 min 0 max 4096" << std::endl;
+			std::cout << "option name EvalFile type string default <embedded>" << std::endl;
+			// Elsewhere the int8 output layer only costs accuracy
+			if (int8_network_faster())
+				std::cout << "option name EvalInt8 type check default false" << std::endl;
 			std::cout << "uciok" << std::endl;
 		} else if (command == "isend") {
 			auto legal_moves = pzstd::vector<Move>();
@@ -35,8 +63,66 @@ int main(int argc, char *argv[]) {
 			board.print_board();
 		} else if (command == "isready") {
 			std::cout << "readyok" << std::endl;
+		} else if (command.substr(0, 9) == "setoption") {
+			stop_and_join();
+			// `setoption name <id> value <x>`
+			std::stringstream ss(command);
+			std::string token, name, value;
+			ss >> token >> token;
+			while (ss >> token && token != "value")
+				name += (name.empty() ? "" : " ") + token;
+			// The value runs to the end of the line, file paths may contain spaces
+			std::getline(ss >> std::ws, value);
+			if (name == "Hash") {
+				set_hash_size(std::stoi(value));
+			} else if (name == "Threads") {
+				set_threads(std::stoi(value));
+			} else if (name == "PipelineDepth") {
+				set_pipeline_depth(std::stoi(value));
+			} else if (name == "MultiPV") {
+				set_multipv(std::stoi(value));
+			} else if (name == "InfoInterval") {
+				set_info_interval(std::stoi(value));
+			} else if (name == "Deterministic") {
+				set_deterministic(value == "true");
+			} else if (name == "GumbelRoot") {
+				set_gumbel(value == "true");
+			} else if (name == "RAVE") {
+				set_rave(value == "true");
+			} else if (name == "ProgressiveWidening") {
+				set_widening(value == "true");
+			} else if (name == "ValuePriors") {
+				set_value_priors(value == "true");
+			} else if (name == "PolicyPriors") {
+				set_policy_priors(value == "true");
+			} else if (name == "RolloutMode") {
+				set_rollout_mode(value == "Random" ? ROLLOUT_RANDOM : value == "Batch" ? ROLLOUT_BATCH : ROLLOUT_HYBRID);
+			} else if (name == "RolloutPolicy") {
+				set_rollout_policy(value == "MAST" ? ROLLOUT_MAST : value == "NST" ? ROLLOUT_NST : ROLLOUT_UNIFORM);
+			} else if (name == "Adjudication") {
+				set_adjudication(value == "true");
+			} else if (name == "EvalCache") {
+				eval_cache.resize(std::stoi(value));
+			} else if (name == "EvalFile") {
+				std::string error;
+				if (value.empty() || value == "<embedded>") {
+					load_embedded_network();
+				} else if (!load_network_file(value, error)) {
+					std::cout << "info string failed to load " << value << ": " << error << std::endl;
+					continue;
+				}
+				// Cached scores belong to the previous network
+				eval_cache.clear();
+				std::cout << "info string using network " << (value.empty() ? "<embedded>" : value) << " (" << network_description() << ")" << std::endl;
+			} else if (name == "EvalInt8" && int8_network_faster()) {
+				use_int8_network(value == "true");
+				eval_cache.clear();
+				std::cout << "info string using network " << network_description() << std::endl;
+			}
 		} else if (command == "ucinewgame") {
+			stop_and_join();
 			board = Board();
+			rollout_tables.clear();
 		} else if (command.substr(0, 8) == "position") {
 			// either `position startpos` or `position fen ...`
 			if (command.find("startpos") != std::string::npos) {
@@ -59,41 +145,51 @@ int main(int argc, char *argv[]) {
 		} else if (command == "quit") {
 			break;
 		} else if (command == "stop") {
-			// stop the search thread
-			// if (searchthread.joinable()) {
-			// 	searchthread.join();
-			// }
+			stop_and_join();
 		} else if (command.substr(0, 2) == "go") {
-			// `go wtime ... btime ... winc ... binc ...`
-			// only care about wtime and btime
+			// `go wtime ... btime ... winc ... binc ... movestogo ... movetime ... nodes ... depth ... infinite searchmoves ...`
 			std::stringstream ss(command);
 			std::string token;
-			int wtime = 0, btime = 0, winc = 0, binc = 0;
-			int depth = -1;
-			int nodes = -1;
-			bool inf = false;
+			SearchLimits limits;
+			bool searchmoves = false;
 			ss >> token;
 			while (ss >> token) {
 				if (token == "wtime") {
-					ss >> wtime;
+					ss >> limits.time[WHITE];
 				} else if (token == "btime") {
-					ss >> btime;
+					ss >> limits.time[BLACK];
 				} else if (token == "winc") {
-					ss >> winc;
+					ss >> limits.inc[WHITE];
 				} else if (token == "binc") {
-					ss >> binc;
+					ss >> limits.inc[BLACK];
+				} else if (token == "movestogo") {
+					ss >> limits.movestogo;
+				} else if (token == "movetime") {
+					ss >> limits.movetime;
+				} else if (token == "nodes") {
+					ss >> limits.nodes;
+				} else if (token == "depth") {
+					ss >> limits.depth;
 				} else if (token == "infinite") {
-					inf = true;
+					limits.infinite = true;
+				} else if (token == "searchmoves") {
+					searchmoves = true;
+				} else if (searchmoves) {
+					// Anything that is not a keyword after `searchmoves` is one of its moves
+					limits.searchmoves.push_back(Move::from_string(token, &board));
 				}
 			}
-			int timeleft = board.side ? btime : wtime;
-			int inc = board.side ? binc : winc;
-			std::pair<Move, Value> res;
-			if (inf)
-				res = search(board, 1e9);
-			else
-				res = search(board, timemgmt(timeleft, inc, online));
-			std::cout << "bestmove " << res.first.to_string() << " eval " << res.second << std::endl;
+			// Without any limit the search would never end, fall back to the old fixed budget
+			if (!limits.infinite && limits.movetime < 0 && limits.nodes < 0 && !limits.time[board.side])
+				limits.nodes = 50000;
+			stop_and_join();
+			clear_stop();
+			// The search thread works on its own copy so the next `position` can't pull the board out from under it
+			searchthread = std::thread([limits, online, board]() mutable {
+				std::pair<Move, Value> res = search(board, limits, online);
+				std::cout << "bestmove " << res.first.to_string() << " eval " << res.second << std::endl;
+			});
 		}
 	}
+	stop_and_join();
 }
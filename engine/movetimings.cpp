@@ -0,0 +1,74 @@
+#include "movetimings.hpp"
+
+void TimeManager::init(const SearchLimits &limits, bool side, bool online) {
+	start = clock::now();
+	limited = !limits.infinite && (limits.movetime >= 0 || limits.time[side] > 0);
+	dynamic = limited && limits.movetime < 0;
+	instability = 0;
+	if (!limited)
+		return;
+
+	int64_t soft_ms, hard_ms;
+	if (limits.movetime >= 0) {
+		soft_ms = hard_ms = std::max<int64_t>(1, limits.movetime - MOVE_OVERHEAD);
+	} else {
+		const int64_t remtime = std::max<int64_t>(1, limits.time[side] - MOVE_OVERHEAD);
+		const int64_t inc = limits.inc[side];
+		// Spread the clock over the moves left until the next time control, or 25 moves in sudden death
+		const int64_t mtg = limits.movestogo > 0 ? limits.movestogo : 25;
+		if (online && remtime < 5000)
+			soft_ms = 100;
+		else
+			soft_ms = remtime / mtg + inc * 3 / 5;
+		// Never plan on using more than 40% of what is left, and do not lose on time with the last move before the control
+		hard_ms = std::min(soft_ms * 3, remtime * 2 / 5);
+		if (limits.movestogo == 1)
+			hard_ms = remtime * 4 / 5;
+		soft_ms = std::max<int64_t>(1, std::min(soft_ms, hard_ms));
+		hard_ms = std::max(hard_ms, soft_ms);
+	}
+	planned = soft_ms;
+	soft = start + std::chrono::milliseconds(soft_ms);
+	hard = start + std::chrono::milliseconds(hard_ms);
+}
+
+bool TimeManager::update(int64_t sims, int best, int second, bool best_changed) {
+	if (!dynamic || best <= 0)
+		return false;
+
+	// A best move that keeps changing is worth up to twice the planned time
+	instability = instability * 0.9 + best_changed;
+	const double unstable = std::min(2.0, 1 + 0.25 * instability);
+	// A close race between the top two moves stretches the budget, a runaway leader shrinks it
+	const double close = 0.6 + 0.8 * second / best;
+	const int64_t budget = planned * unstable * close;
+	soft = std::min(hard, start + std::chrono::milliseconds(std::max<int64_t>(budget, 1)));
+
+	// Estimate how many simulations fit before the soft deadline at the current speed
+	const clock::time_point now = clock::now();
+	const int64_t elapsed_us = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+	const int64_t left_us = std::chrono::duration_cast<std::chrono::microseconds>(soft - now).count();
+	const int64_t remaining = left_us > 0 ? sims * left_us / elapsed_us : 0;
+	return best - second > remaining;
+}
+
+void TimeManager::start_timer(std::atomic<bool> &stop) {
+	cancelled = false;
+	if (!limited)
+		return;
+	timer = std::thread([this, &stop] {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!cv.wait_until(lock, hard, [this] { return cancelled; }))
+			stop.store(true, std::memory_order_relaxed);
+	});
+}
+
+void TimeManager::stop_timer() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+	}
+	cv.notify_all();
+	if (timer.joinable())
+		timer.join();
+}
@@ -2,8 +2,65 @@
 
 #include "includes.hpp"
 
-uint64_t timemgmt(int64_t remtime, int64_t inc = 0, bool online = 0) {
-	// Return time in ms that we can spend on this move
-	if (online && remtime < 5000) return 100;
-	return std::max(1ll, (long long)(remtime / 25 + inc * 3 / 5));
-}
+#include "move.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Time reserved for communication lag on every move, in ms
+#define MOVE_OVERHEAD 10
+
+// Everything `go` can ask for, times in ms, -1 / 0 when not given
+struct SearchLimits {
+	int64_t time[2] = {0, 0};
+	int64_t inc[2] = {0, 0};
+	int movestogo = 0;
+	int64_t movetime = -1;
+	int64_t nodes = -1;
+	int depth = -1;
+	bool infinite = false;
+	std::vector<Move> searchmoves; // Root moves to consider, empty for all of them
+};
+
+// Wall clock time control for one search
+// The search stops on its own at the soft deadline, the hard deadline is enforced by a timer thread raising a stop flag
+struct TimeManager {
+	typedef std::chrono::steady_clock clock;
+
+	clock::time_point start, soft, hard;
+	bool limited = false;
+	bool dynamic = false; // Whether the soft deadline may move, false for fixed movetime
+	int64_t planned = 0; // Soft budget before any adjustment, in ms
+	double instability = 0; // Decaying count of best move changes
+
+	// Computes the deadlines for side to move, starting the clock now
+	void init(const SearchLimits &limits, bool side, bool online = false);
+
+	int64_t elapsed() const {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count();
+	}
+	bool soft_expired() const {
+		return limited && clock::now() >= soft;
+	}
+	bool hard_expired() const {
+		return limited && clock::now() >= hard;
+	}
+
+	// Re-plans the soft deadline from the visit counts of the two most visited root children, call it periodically
+	// Returns true when the best move can no longer be overtaken before the soft deadline
+	bool update(int64_t sims, int best, int second, bool best_changed);
+
+	// Raises stop once the hard deadline passes, until stop_timer() is called
+	void start_timer(std::atomic<bool> &stop);
+	void stop_timer();
+
+private:
+	std::thread timer;
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool cancelled = false;
+};
@@ -1,19 +1,262 @@
 #include "network.hpp"
 #include "incbin.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 extern "C" {
 	INCBIN(network_weights, VALUE_HEAD);
 }
 
-void Network::load() {
-	char *ptr = (char *)gnetwork_weightsData;
-	memcpy(accumulator_weights, ptr, sizeof(accumulator_weights));
-	ptr += sizeof(accumulator_weights);
-	memcpy(accumulator_biases, ptr, sizeof(accumulator_biases));
-	ptr += sizeof(accumulator_biases);
-	memcpy(output_weights, ptr, sizeof(output_weights));
-	ptr += sizeof(output_weights);
-	memcpy(&output_bias, ptr, sizeof(output_bias));
+#if defined(__AVX512BW__)
+typedef __m512i vec_t;
+#define vec_loadu(p) _mm512_loadu_si512((const void *)(p))
+#define vec_storeu(p, v) _mm512_storeu_si512((void *)(p), v)
+#define vec_add_16(a, b) _mm512_add_epi16(a, b)
+#define vec_sub_16(a, b) _mm512_sub_epi16(a, b)
+#define vec_max_16(a, b) _mm512_max_epi16(a, b)
+#define vec_min_16(a, b) _mm512_min_epi16(a, b)
+#define vec_mullo_16(a, b) _mm512_mullo_epi16(a, b)
+#define vec_madd_16(a, b) _mm512_madd_epi16(a, b)
+#define vec_add_32(a, b) _mm512_add_epi32(a, b)
+#define vec_set1_16(x) _mm512_set1_epi16(x)
+#define vec_zero() _mm512_setzero_si512()
+#define vec_reduce_add_32(a) _mm512_reduce_add_epi32(a)
+#define vec_load_i8(p) _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(p)))
+#define vec_slli_16(a, n) _mm512_slli_epi16(a, n)
+#define vec_srli_16(a, n) _mm512_srli_epi16(a, n)
+#define vec_packus_16(a, b) _mm512_packus_epi16(a, b)
+#ifdef __AVX512VNNI__
+#define vec_dpbusd(sum, u, s) _mm512_dpbusd_epi32(sum, u, s)
+#ifdef __AVX512VBMI__
+// Looks up the half of every activation byte in a 128 entry table, the permute only reads the low seven bits of
+// avg(a, 255) == 128 + a / 2
+#define SQUARE_LOOKUP
+static inline __m512i vec_square_u8(__m512i a, __m512i table_lo, __m512i table_hi) {
+	return _mm512_permutex2var_epi8(table_lo, _mm512_avg_epu8(a, _mm512_set1_epi8(-1)), table_hi);
+}
+#endif
+#endif
+#define REFRESH_REGS 8
+#elif defined(__AVX2__)
+typedef __m256i vec_t;
+#define vec_loadu(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vec_storeu(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define vec_add_16(a, b) _mm256_add_epi16(a, b)
+#define vec_sub_16(a, b) _mm256_sub_epi16(a, b)
+#define vec_max_16(a, b) _mm256_max_epi16(a, b)
+#define vec_min_16(a, b) _mm256_min_epi16(a, b)
+#define vec_mullo_16(a, b) _mm256_mullo_epi16(a, b)
+#define vec_madd_16(a, b) _mm256_madd_epi16(a, b)
+#define vec_add_32(a, b) _mm256_add_epi32(a, b)
+#define vec_set1_16(x) _mm256_set1_epi16(x)
+#define vec_zero() _mm256_setzero_si256()
+#define vec_load_i8(p) _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(p)))
+#define vec_slli_16(a, n) _mm256_slli_epi16(a, n)
+#define vec_srli_16(a, n) _mm256_srli_epi16(a, n)
+#define vec_packus_16(a, b) _mm256_packus_epi16(a, b)
+#ifdef __AVXVNNI__
+#define vec_dpbusd(sum, u, s) _mm256_dpbusd_avx_epi32(sum, u, s)
+#endif
+#define REFRESH_REGS 4
+
+static inline int32_t vec_reduce_add_32(__m256i a) {
+	__m128i x = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+	x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0b01001110));
+	x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0b10110001));
+	return _mm_cvtsi128_si32(x);
+}
+#endif
+
+#ifdef REFRESH_REGS
+constexpr int VEC_WIDTH = sizeof(vec_t) / sizeof(int16_t);
+#endif
+
+NetworkArch nn_arch = DEFAULT_ARCH;
+const void *nn_network = nullptr;
+const void *nn_network_i8 = nullptr;
+const void *nn_policy = nullptr;
+
+template <typename Net>
+static int quantize_erased(const void *net, void *out) {
+	quantize_network(*(const Net *)net, *(NetworkI8<Net> *)out);
+	return ((const NetworkI8<Net> *)out)->saturated;
+}
+
+// What the loader needs to know about each compiled-in architecture
+struct ArchInfo {
+	uint32_t hl_size, nbuckets, qa, qb, scale;
+	size_t bytes, align, i8_size, policy_bytes;
+	int (*quantize)(const void *, void *); // Returns the number of saturated output weights
+};
+
+static const ArchInfo archs[NARCHS] = {
+#define X(hl, nb, qa, qb, scale)                                                                                                          \
+	{hl, nb, qa, qb, scale, Network<hl, nb, qa, qb, scale>::BYTES, alignof(Network<hl, nb, qa, qb, scale>),                              \
+	 sizeof(NetworkI8<Network<hl, nb, qa, qb, scale>>), PolicyHead<hl>::BYTES, quantize_erased<Network<hl, nb, qa, qb, scale>>},
+	NETWORK_ARCHS(X)
+#undef X
+};
+
+// Storage for the int8 network, re-quantized whenever the active network changes
+static void *quantized = nullptr;
+static NetworkArch quantized_arch = NARCHS;
+static bool int8_enabled = false;
+static int quantized_saturated = 0;
+
+// Mapping backing nn_network when it was loaded from a file, released when another network replaces it
+static void *mapped_base = nullptr;
+static size_t mapped_size = 0;
+// Fallback storage for when the embedded weights are not aligned enough to be used in place
+static DefaultNetwork *embedded_copy = nullptr;
+
+static void release_mapping() {
+	if (mapped_base)
+		munmap(mapped_base, mapped_size);
+	mapped_base = nullptr;
+	mapped_size = 0;
+}
+
+uint64_t network_checksum(const void *data, size_t size) {
+	const uint8_t *ptr = (const uint8_t *)data;
+	uint64_t crc = ~0ULL;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, ptr + i, sizeof(word));
+		crc = _mm_crc32_u64(crc, word);
+	}
+	for (; i < size; i++)
+		crc = _mm_crc32_u8(crc, ptr[i]);
+	return ~crc & 0xffffffff;
+}
+
+static void update_int8_network() {
+	if (!int8_enabled) {
+		nn_network_i8 = nullptr;
+		return;
+	}
+	if (quantized_arch != nn_arch) {
+		if (quantized)
+			operator delete(quantized, std::align_val_t(64));
+		quantized = operator new(archs[nn_arch].i8_size, std::align_val_t(64));
+		quantized_arch = nn_arch;
+	}
+	quantized_saturated = archs[nn_arch].quantize(nn_network, quantized);
+	nn_network_i8 = quantized;
+}
+
+void use_int8_network(bool enabled) {
+	int8_enabled = enabled;
+	update_int8_network();
+}
+
+bool int8_network_faster() {
+#ifdef SQUARE_LOOKUP
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::string network_description() {
+	const ArchInfo &arch = archs[nn_arch];
+	std::string precision = " int16";
+	if (nn_network_i8)
+		precision = " int8 output, " + std::to_string(quantized_saturated) + " weights saturated";
+	return std::to_string(INPUT_SIZE) + "->" + std::to_string(arch.hl_size) + "x2->" + std::to_string(arch.nbuckets) + precision +
+		   (nn_policy ? " with policy" : "");
+}
+
+void load_embedded_network() {
+	release_mapping();
+	nn_arch = DEFAULT_ARCH;
+	nn_policy = nullptr;
+	if ((uintptr_t)gnetwork_weightsData % alignof(DefaultNetwork) == 0) {
+		nn_network = gnetwork_weightsData;
+		update_int8_network();
+		return;
+	}
+	if (!embedded_copy) {
+		embedded_copy = new DefaultNetwork;
+		memcpy((void *)embedded_copy, gnetwork_weightsData, DefaultNetwork::BYTES);
+	}
+	nn_network = embedded_copy;
+	update_int8_network();
+}
+
+bool load_network_file(const std::string &path, std::string &error) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error = "cannot open " + path;
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(NetworkHeader)) {
+		close(fd);
+		error = path + " is too small to be a network";
+		return false;
+	}
+	// Shared read-only mapping, so every engine process using this file shares the same page cache pages
+	void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		error = "cannot map " + path;
+		return false;
+	}
+	madvise(base, st.st_size, MADV_WILLNEED);
+
+	const NetworkHeader *header = (const NetworkHeader *)base;
+	const char *payload = (const char *)base;
+	NetworkArch arch = DEFAULT_ARCH;
+	const char *policy = nullptr;
+	if (memcmp(header->magic, NETWORK_MAGIC, sizeof(header->magic)) == 0) {
+		payload += sizeof(NetworkHeader);
+		// Pick the compiled-in architecture the header describes
+		arch = NARCHS;
+		for (int i = 0; i < NARCHS; i++) {
+			if (header->hl_size == archs[i].hl_size && header->nbuckets == archs[i].nbuckets && header->qa == archs[i].qa &&
+				header->qb == archs[i].qb && header->scale == archs[i].scale)
+				arch = NetworkArch(i);
+		}
+		if (header->version != NETWORK_VERSION) {
+			error = "unsupported network version " + std::to_string(header->version);
+		} else if (header->input_size != INPUT_SIZE || arch == NARCHS) {
+			error = "no compiled-in architecture matches " + std::to_string(header->input_size) + "->" + std::to_string(header->hl_size) + "x2->" +
+					std::to_string(header->nbuckets);
+		} else {
+			// The policy section starts on the next cache line after the value weights
+			const size_t policy_offset = (archs[arch].bytes + 63) & ~(size_t)63;
+			const size_t checked = header->policy_size ? policy_offset + header->policy_size : archs[arch].bytes;
+			if (header->payload_size != archs[arch].bytes || st.st_size < (off_t)(sizeof(NetworkHeader) + checked)) {
+				error = "network payload has the wrong size";
+			} else if (header->policy_size && header->policy_size != archs[arch].policy_bytes) {
+				error = "policy head has the wrong size";
+			} else if (network_checksum(payload, checked) != header->checksum) {
+				error = "network checksum mismatch";
+			} else if (header->policy_size) {
+				policy = payload + policy_offset;
+			}
+		}
+	} else if (st.st_size < (off_t)DefaultNetwork::BYTES || st.st_size >= (off_t)(DefaultNetwork::BYTES + 64)) {
+		// Headerless files are accepted as long as they look like a bare (possibly padded) default network
+		error = path + " is not a network file";
+	}
+	if (!error.empty()) {
+		munmap(base, st.st_size);
+		return false;
+	}
+
+	release_mapping();
+	mapped_base = base;
+	mapped_size = st.st_size;
+	nn_arch = arch;
+	nn_network = payload;
+	nn_policy = policy;
+	update_int8_network();
+	return true;
 }
 
 int calculate_index(Square sq, PieceType pt, bool side, bool perspective) {
@@ -24,35 +267,301 @@ int calculate_index(Square sq, PieceType pt, bool side, bool perspective) {
 	return side * 64 * 6 + pt * 64 + sq;
 }
 
-void accumulator_add(const Network &net, Accumulator &acc, uint16_t index) {
+template <typename T>
+struct is_quantized : std::false_type {};
+template <typename Net>
+struct is_quantized<NetworkI8<Net>> : std::true_type {};
+
+template <typename Net>
+void accumulator_add(const Net &net, typename Net::Accumulator &acc, uint16_t index) {
 	// Note: do not need to manually vectorize this, compiler will do it for us
-	for (int i = 0; i < HL_SIZE; i++) {
+	for (int i = 0; i < Net::HL_SIZE; i++) {
 		acc.val[i] += net.accumulator_weights[index][i];
 	}
 }
 
-void accumulator_sub(const Network &net, Accumulator &acc, uint16_t index) {
+template <typename Net>
+void accumulator_sub(const Net &net, typename Net::Accumulator &acc, uint16_t index) {
 	// Note: do not need to manually vectorize this, compiler will do it for us
-	for (int i = 0; i < HL_SIZE; i++) {
+	for (int i = 0; i < Net::HL_SIZE; i++) {
 		acc.val[i] -= net.accumulator_weights[index][i];
 	}
 }
 
-int32_t nn_eval(const Network &net, const Accumulator &stm, const Accumulator &ntm, uint8_t nbucket) {
-	/// TODO: vectorize
-	int32_t score = 0;
-	for (int i = 0; i < HL_SIZE; i++) {
-		int input = std::clamp((int)stm.val[i], 0, QA);
-		int weight = input * net.output_weights[nbucket][i];
-		score += input * weight;
+template <typename Net>
+void accumulator_refresh(const Net &net, typename Net::Accumulator &w_acc, typename Net::Accumulator &b_acc, const uint16_t *w_idx, const uint16_t *b_idx, int n) {
+#ifdef REFRESH_REGS
+	// Walk the hidden layer in tiles small enough that the running sums of both perspectives stay in registers,
+	// so each accumulator is only stored once and the weight rows are streamed four at a time
+	constexpr int WIDTH = VEC_WIDTH;
+	constexpr int REGS = std::min(REFRESH_REGS, Net::HL_SIZE / WIDTH);
+	constexpr int TILE = REGS * WIDTH;
+	static_assert(Net::HL_SIZE % TILE == 0, "hidden layer must be a multiple of the refresh tile");
+
+	for (int t = 0; t < Net::HL_SIZE; t += TILE) {
+		vec_t w[REGS], b[REGS];
+		for (int r = 0; r < REGS; r++)
+			w[r] = b[r] = vec_loadu(net.accumulator_biases + t + r * WIDTH);
+
+		int i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const auto *w0 = net.accumulator_weights[w_idx[i]] + t, *w1 = net.accumulator_weights[w_idx[i + 1]] + t;
+			const auto *w2 = net.accumulator_weights[w_idx[i + 2]] + t, *w3 = net.accumulator_weights[w_idx[i + 3]] + t;
+			const auto *b0 = net.accumulator_weights[b_idx[i]] + t, *b1 = net.accumulator_weights[b_idx[i + 1]] + t;
+			const auto *b2 = net.accumulator_weights[b_idx[i + 2]] + t, *b3 = net.accumulator_weights[b_idx[i + 3]] + t;
+			for (int r = 0; r < REGS; r++) {
+				const int o = r * WIDTH;
+				w[r] = vec_add_16(w[r], vec_add_16(vec_add_16(vec_loadu(w0 + o), vec_loadu(w1 + o)), vec_add_16(vec_loadu(w2 + o), vec_loadu(w3 + o))));
+				b[r] = vec_add_16(b[r], vec_add_16(vec_add_16(vec_loadu(b0 + o), vec_loadu(b1 + o)), vec_add_16(vec_loadu(b2 + o), vec_loadu(b3 + o))));
+			}
+		}
+		for (; i < n; i++) {
+			const auto *w0 = net.accumulator_weights[w_idx[i]] + t;
+			const auto *b0 = net.accumulator_weights[b_idx[i]] + t;
+			for (int r = 0; r < REGS; r++) {
+				w[r] = vec_add_16(w[r], vec_loadu(w0 + r * WIDTH));
+				b[r] = vec_add_16(b[r], vec_loadu(b0 + r * WIDTH));
+			}
+		}
+
+		for (int r = 0; r < REGS; r++) {
+			vec_storeu(w_acc.val + t + r * WIDTH, w[r]);
+			vec_storeu(b_acc.val + t + r * WIDTH, b[r]);
+		}
+	}
+#else
+	memcpy(w_acc.val, net.accumulator_biases, sizeof(w_acc.val));
+	memcpy(b_acc.val, net.accumulator_biases, sizeof(b_acc.val));
+	for (int i = 0; i < n; i++) {
+		accumulator_add(net, w_acc, w_idx[i]);
+		accumulator_add(net, b_acc, b_idx[i]);
+	}
+#endif
+}
 
-		input = std::clamp((int)ntm.val[i], 0, QA);
-		weight = input * net.output_weights[nbucket][HL_SIZE + i];
-		score += input * weight;
+template <typename Net>
+void accumulator_update(const Net &net, const typename Net::Accumulator &src, typename Net::Accumulator &dst, const uint16_t *add, int nadd, const uint16_t *sub, int nsub) {
+	// Copy, add and subtract in one pass so the child accumulator is written exactly once
+#ifdef REFRESH_REGS
+	for (int i = 0; i < Net::HL_SIZE; i += VEC_WIDTH) {
+		vec_t v = vec_loadu(src.val + i);
+		for (int j = 0; j < nadd; j++)
+			v = vec_add_16(v, vec_loadu(net.accumulator_weights[add[j]] + i));
+		for (int j = 0; j < nsub; j++)
+			v = vec_sub_16(v, vec_loadu(net.accumulator_weights[sub[j]] + i));
+		vec_storeu(dst.val + i, v);
 	}
-	score /= QA;
+#else
+	dst = src;
+	for (int j = 0; j < nadd; j++)
+		accumulator_add(net, dst, add[j]);
+	for (int j = 0; j < nsub; j++)
+		accumulator_sub(net, dst, sub[j]);
+#endif
+}
+
+template <typename Net>
+static inline int32_t finalize_score(const Net &net, int64_t score, uint8_t nbucket) {
+	score /= Net::QA;
 	score += net.output_bias[nbucket];
-	score *= SCALE;
-	score /= QA * QB;
+	score *= Net::SCALE;
+	score /= Net::QA * Net::QB;
+	return score;
+}
+
+template <typename Net>
+static void nn_eval_batch_i16(const Net &net, const typename Net::Accumulator *stm, const typename Net::Accumulator *ntm, const uint8_t *nbuckets, int n, int32_t *out) {
+	constexpr int HL = Net::HL_SIZE;
+#ifdef REFRESH_REGS
+	// SCReLU via clamp(x)^2 * w == (clamp(x) * w) * clamp(x), where the first product fits in 16 bits
+	// Positions are interleaved four at a time so the independent dot products overlap in the pipeline
+	constexpr int LANES = 4;
+	const vec_t zero = vec_zero();
+	const vec_t qa = vec_set1_16(Net::QA);
+	for (int b = 0; b < n; b += LANES) {
+		const int cnt = std::min(LANES, n - b);
+		vec_t sum[LANES];
+		const int16_t *w[LANES];
+		for (int k = 0; k < LANES; k++) {
+			sum[k] = zero;
+			w[k] = net.output_weights[nbuckets[b + std::min(k, cnt - 1)]];
+		}
+		for (int i = 0; i < HL; i += VEC_WIDTH) {
+			for (int k = 0; k < cnt; k++) {
+				vec_t us = vec_min_16(vec_max_16(vec_loadu(stm[b + k].val + i), zero), qa);
+				vec_t them = vec_min_16(vec_max_16(vec_loadu(ntm[b + k].val + i), zero), qa);
+				sum[k] = vec_add_32(sum[k], vec_madd_16(vec_mullo_16(us, vec_loadu(w[k] + i)), us));
+				sum[k] = vec_add_32(sum[k], vec_madd_16(vec_mullo_16(them, vec_loadu(w[k] + HL + i)), them));
+			}
+		}
+		for (int k = 0; k < cnt; k++)
+			out[b + k] = finalize_score(net, vec_reduce_add_32(sum[k]), nbuckets[b + k]);
+	}
+#else
+	for (int b = 0; b < n; b++) {
+		int32_t score = 0;
+		for (int i = 0; i < HL; i++) {
+			int input = std::clamp((int)stm[b].val[i], 0, Net::QA);
+			int weight = input * net.output_weights[nbuckets[b]][i];
+			score += input * weight;
+
+			input = std::clamp((int)ntm[b].val[i], 0, Net::QA);
+			weight = input * net.output_weights[nbuckets[b]][HL + i];
+			score += input * weight;
+		}
+		out[b] = finalize_score(net, score, nbuckets[b]);
+	}
+#endif
+}
+
+// Position of hidden neuron i within the bytes produced by vec_packus_16, which interleaves its inputs per 128 bit lane
+static int packed_position(int i) {
+#ifdef vec_dpbusd
+	const int block = i / (2 * VEC_WIDTH) * (2 * VEC_WIDTH); // Two vectors of activations are packed together
+	const int j = i - block;
+	const int half = j / VEC_WIDTH; // Which of the two packed vectors it came from
+	const int lane = j % VEC_WIDTH / 8, k = j % 8;
+	return block + lane * 16 + half * 8 + k;
+#else
+	return i;
+#endif
+}
+
+template <typename Net>
+void quantize_network(const Net &net, NetworkI8<Net> &out) {
+	constexpr int HL_SIZE = Net::HL_SIZE;
+	out.accumulator_weights = net.accumulator_weights;
+	out.accumulator_biases = net.accumulator_biases;
+	out.saturated = 0;
+	for (int b = 0; b < Net::NBUCKETS; b++) {
+		for (int i = 0; i < 2 * HL_SIZE; i++) {
+			const int half = i / HL_SIZE, j = i % HL_SIZE, w = net.output_weights[b][i];
+			out.saturated += w < -127 || w > 127;
+			out.output_weights[b][half * HL_SIZE + packed_position(j)] = std::clamp(w, -127, 127);
+		}
+		out.output_bias[b] = net.output_bias[b];
+	}
+	for (int j = 0; j < 128; j++) {
+		const int even = std::min(2 * j, Net::QA), odd = std::min(2 * j + 1, Net::QA);
+		out.squares[j] = (even * even + odd * odd + 256) >> 9;
+	}
+}
+
+template <typename Net>
+static void nn_eval_batch_i8(const Net &net, const typename Net::Accumulator *stm, const typename Net::Accumulator *ntm, const uint8_t *nbuckets, int n, int32_t *out) {
+	constexpr int HL_SIZE = Net::HL_SIZE;
+#ifdef SQUARE_LOOKUP
+	const vec_t squares_lo = vec_loadu(net.squares), squares_hi = vec_loadu(net.squares + 64);
+#endif
+	// One position at a time, with a dpbusd chain per perspective: positions are independent, so out of order
+	// execution overlaps them without the bookkeeping of the interleaved int16 kernel
+	for (int b = 0; b < n; b++) {
+		int64_t score = 0;
+#ifdef REFRESH_REGS
+		vec_t sum[2] = {vec_zero(), vec_zero()};
+		for (int h = 0; h < 2; h++) {
+			const int16_t *acc = (h ? ntm : stm)[b].val;
+			const int8_t *weights = net.output_weights[nbuckets[b]] + h * HL_SIZE;
+			for (int i = 0; i < HL_SIZE; i += 2 * VEC_WIDTH) {
+#ifdef SQUARE_LOOKUP
+				// Packing with unsigned saturation is the clamp to [0, 255], the table does the rest
+				const vec_t sq = vec_square_u8(vec_packus_16(vec_loadu(acc + i), vec_loadu(acc + i + VEC_WIDTH)), squares_lo, squares_hi);
+				sum[h] = vec_dpbusd(sum[h], sq, vec_loadu(weights + i));
+#else
+				const vec_t zero = vec_zero(), qa = vec_set1_16(Net::QA), one = vec_set1_16(1), round = vec_set1_16(64);
+				vec_t lo = vec_min_16(vec_max_16(vec_loadu(acc + i), zero), qa);
+				vec_t hi = vec_min_16(vec_max_16(vec_loadu(acc + i + VEC_WIDTH), zero), qa);
+				// The table entry of j = a / 2 is (j * (2j + 1) + 64) >> 7, the identity saves widening to 32 bits
+				lo = vec_srli_16(lo, 1);
+				hi = vec_srli_16(hi, 1);
+				lo = vec_srli_16(vec_add_16(vec_mullo_16(lo, vec_add_16(vec_slli_16(lo, 1), one)), round), 7);
+				hi = vec_srli_16(vec_add_16(vec_mullo_16(hi, vec_add_16(vec_slli_16(hi, 1), one)), round), 7);
+#ifdef vec_dpbusd
+				// Unsigned squares times signed weights, four bytes at a time into each 32 bit lane
+				sum[h] = vec_dpbusd(sum[h], vec_packus_16(lo, hi), vec_loadu(weights + i));
+#else
+				sum[h] = vec_add_32(sum[h], vec_madd_16(lo, vec_load_i8(weights + i)));
+				sum[h] = vec_add_32(sum[h], vec_madd_16(hi, vec_load_i8(weights + i + VEC_WIDTH)));
+#endif
+#endif
+			}
+		}
+		score = vec_reduce_add_32(vec_add_32(sum[0], sum[1]));
+#else
+		for (int i = 0; i < 2 * HL_SIZE; i++) {
+			const int input = std::clamp((int)(i < HL_SIZE ? stm : ntm)[b].val[i % HL_SIZE], 0, Net::QA);
+			score += net.squares[input >> 1] * net.output_weights[nbuckets[b]][i];
+		}
+#endif
+		// The squares were divided by 256 to fit in a byte
+		out[b] = finalize_score(net, score << 8, nbuckets[b]);
+	}
+}
+
+template <typename Net>
+void nn_eval_batch(const Net &net, const typename Net::Accumulator *stm, const typename Net::Accumulator *ntm, const uint8_t *nbuckets, int n, int32_t *out) {
+	if constexpr (is_quantized<Net>::value)
+		nn_eval_batch_i8(net, stm, ntm, nbuckets, n, out);
+	else
+		nn_eval_batch_i16(net, stm, ntm, nbuckets, n, out);
+}
+
+template <typename Net>
+int32_t nn_eval(const Net &net, const typename Net::Accumulator &stm, const typename Net::Accumulator &ntm, uint8_t nbucket) {
+	int32_t score;
+	nn_eval_batch(net, &stm, &ntm, &nbucket, 1, &score);
 	return score;
 }
+
+// Both weight formats share the feature transformer, so the network itself only picks the instantiation
+template <typename Net>
+void policy_logits(const Net &, const PolicyHead<Net::HL_SIZE> &policy, const typename Net::Accumulator &stm, const uint16_t *indices, int n, float *out) {
+	constexpr int HL = Net::HL_SIZE;
+	alignas(64) int16_t act[HL];
+	for (int i = 0; i < HL; i++)
+		act[i] = std::clamp((int)stm.val[i], 0, Net::QA);
+
+	// The activations are shared by every move, so each logit is a single row dot product
+	constexpr int LANES = 4;
+	for (int b = 0; b < n; b += LANES) {
+		const int cnt = std::min(LANES, n - b);
+		int32_t sums[LANES] = {};
+#ifdef REFRESH_REGS
+		vec_t sum[LANES];
+		for (int k = 0; k < LANES; k++)
+			sum[k] = vec_zero();
+		for (int i = 0; i < HL; i += VEC_WIDTH) {
+			const vec_t a = vec_loadu(act + i);
+			for (int k = 0; k < cnt; k++)
+				sum[k] = vec_add_32(sum[k], vec_madd_16(a, vec_load_i8(policy.weights[indices[b + k]] + i)));
+		}
+		for (int k = 0; k < cnt; k++)
+			sums[k] = vec_reduce_add_32(sum[k]);
+#else
+		for (int k = 0; k < cnt; k++)
+			for (int i = 0; i < HL; i++)
+				sums[k] += act[i] * policy.weights[indices[b + k]][i];
+#endif
+		for (int k = 0; k < cnt; k++)
+			out[b + k] = (float)(sums[k] + policy.bias[indices[b + k]]) / (Net::QA * POLICY_QP);
+	}
+}
+
+// Every kernel is instantiated for each architecture in both weight formats
+#define INSTANTIATE_KERNELS(Net)                                                                                                                               \
+	template void accumulator_add<Net>(const Net &, Net::Accumulator &, uint16_t);                                                                             \
+	template void accumulator_sub<Net>(const Net &, Net::Accumulator &, uint16_t);                                                                             \
+	template void accumulator_refresh<Net>(const Net &, Net::Accumulator &, Net::Accumulator &, const uint16_t *, const uint16_t *, int);                      \
+	template void accumulator_update<Net>(const Net &, const Net::Accumulator &, Net::Accumulator &, const uint16_t *, int, const uint16_t *, int);             \
+	template void nn_eval_batch<Net>(const Net &, const Net::Accumulator *, const Net::Accumulator *, const uint8_t *, int, int32_t *);                        \
+	template void policy_logits<Net>(const Net &, const PolicyHead<Net::HL_SIZE> &, const Net::Accumulator &, const uint16_t *, int, float *); \
+	template int32_t nn_eval<Net>(const Net &, const Net::Accumulator &, const Net::Accumulator &, uint8_t);
+#define X(hl, nb, qa, qb, scale)                                                                                                                               \
+	INSTANTIATE_KERNELS(Network<hl COMMA nb COMMA qa COMMA qb COMMA scale>)                                                                                     \
+	INSTANTIATE_KERNELS(NetworkI8<Network<hl COMMA nb COMMA qa COMMA qb COMMA scale>>)                                                                          \
+	template void quantize_network(const Network<hl, nb, qa, qb, scale> &, NetworkI8<Network<hl, nb, qa, qb, scale>> &);
+#define COMMA ,
+NETWORK_ARCHS(X)
+#undef COMMA
+#undef X
+#undef INSTANTIATE_KERNELS
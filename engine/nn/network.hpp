@@ -2,30 +2,175 @@
 
 #include "../includes.hpp"
 
+// The input features are fixed by the board encoding: 2 colors * 6 piece types * 64 squares
 #define INPUT_SIZE 768
-#define HL_SIZE 256
-#define NBUCKETS 8
-#define SCALE 400
-#define QA 255
-#define QB 64
-
-struct Accumulator {
-	int16_t val[HL_SIZE] = {};
+
+// Network files start with a 64 byte header followed by the raw Network layout
+#define NETWORK_MAGIC "MCPLNNUE"
+#define NETWORK_VERSION 1
+
+// Moves are indexed from-to from the mover's perspective, followed by underpromotions by file pair and piece
+#define POLICY_SIZE (64 * 64 + 8 * 8 * 3)
+// Policy weights are scaled by POLICY_QP, biases by QA * POLICY_QP
+#define POLICY_QP 64
+
+// Upper bound on the number of active features of a position (one per occupied square)
+#define MAX_ACTIVE 64
+
+// Every architecture compiled into the engine: X(hidden layer size, output buckets, QA, QB, SCALE)
+// A network file is matched against this list through its header, so adding an entry is all it takes to support a new size
+#define NETWORK_ARCHS(X)        \
+	X(128, 8, 255, 64, 400)     \
+	X(256, 8, 255, 64, 400)     \
+	X(512, 8, 255, 64, 400)
+
+template <int HL>
+struct AccumulatorT {
+	alignas(64) int16_t val[HL] = {};
 };
 
+template <int HL_, int NB_, int QA_, int QB_, int SCALE_>
 struct Network {
-	int16_t accumulator_weights[INPUT_SIZE][HL_SIZE];
+	static constexpr int HL_SIZE = HL_;
+	static constexpr int NBUCKETS = NB_;
+	static constexpr int QA = QA_;
+	static constexpr int QB = QB_;
+	static constexpr int SCALE = SCALE_;
+	typedef AccumulatorT<HL_SIZE> Accumulator;
+
+	alignas(64) int16_t accumulator_weights[INPUT_SIZE][HL_SIZE];
 	int16_t accumulator_biases[HL_SIZE];
 	int16_t output_weights[NBUCKETS][2 * HL_SIZE];
 	int16_t output_bias[NBUCKETS];
 
-	void load();
+	// Size of the weights as stored on disk, without the struct's tail padding
+	static constexpr size_t BYTES = sizeof(int16_t) * (INPUT_SIZE * HL_SIZE + HL_SIZE + NBUCKETS * 2 * HL_SIZE + NBUCKETS);
+};
+
+// Optional int8 output layer for a Network, produced by quantize_network()
+// The feature transformer is shared with the int16 network: rounding its weights to int8 takes two bits off every
+// accumulator and costs ~30cp on the embedded network. Only the output layer is quantized, activations are halved and
+// looked up in a table of squares that fit a byte (~3cp), then multiplied with int8 weights four at a time (dpbusd)
+template <typename Net>
+struct NetworkI8 {
+	static constexpr int HL_SIZE = Net::HL_SIZE;
+	static constexpr int NBUCKETS = Net::NBUCKETS;
+	static constexpr int QA = Net::QA;
+	static constexpr int QB = Net::QB;
+	static constexpr int SCALE = Net::SCALE;
+	typedef typename Net::Accumulator Accumulator;
+	static_assert(QA <= 255, "clamped activations must fit in a byte");
+
+	const int16_t (*accumulator_weights)[HL_SIZE];
+	const int16_t *accumulator_biases;
+	alignas(64) int8_t output_weights[NBUCKETS][2 * HL_SIZE]; // Permuted to match the activation packing order
+	int16_t output_bias[NBUCKETS];
+	alignas(64) uint8_t squares[128]; // Mean of the squares of activations 2j and 2j + 1 over 256, rounded
+	int saturated; // Output weights clamped to the int8 range
+};
+
+// Optional policy head on the side-to-move accumulator, one row per move index and CReLU activations
+template <int HL>
+struct PolicyHead {
+	alignas(64) int8_t weights[POLICY_SIZE][HL];
+	int32_t bias[POLICY_SIZE];
+
+	static constexpr size_t BYTES = sizeof(int8_t) * POLICY_SIZE * HL + sizeof(int32_t) * POLICY_SIZE;
+};
+
+enum NetworkArch : uint8_t {
+#define X(hl, nb, qa, qb, scale) ARCH_##hl##_##nb##_##qa##_##qb##_##scale,
+	NETWORK_ARCHS(X)
+#undef X
+	NARCHS
+};
+
+// The network the embedded eval.bin (and headerless files) are assumed to be
+typedef Network<256, 8, 255, 64, 400> DefaultNetwork;
+constexpr NetworkArch DEFAULT_ARCH = ARCH_256_8_255_64_400;
+
+struct NetworkHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t input_size;
+	uint32_t hl_size;
+	uint32_t nbuckets;
+	uint32_t qa;
+	uint32_t qb;
+	uint32_t scale;
+	uint32_t payload_size;
+	uint64_t checksum; // CRC32C of the payload, and of the padding and policy section if there is one
+	uint32_t policy_size; // Bytes of PolicyHead following the payload (padded to 64 bytes), 0 if there is none
+	uint8_t reserved[12];
 };
+static_assert(sizeof(NetworkHeader) == 64, "header must keep the payload cache line aligned");
+
+// The active network, either embedded in the binary or mapped read-only from a file
+extern NetworkArch nn_arch;
+extern const void *nn_network;
+// Quantized copy of nn_network, null unless int8 inference is enabled
+extern const void *nn_network_i8;
+// Policy head of the active network, null if the file does not have one
+extern const void *nn_policy;
+
+// Calls f with the active network as its concrete type, so every architecture gets its own fully specialized code
+template <typename F>
+decltype(auto) with_network(F &&f) {
+	switch (nn_arch) {
+#define X(hl, nb, qa, qb, scale)                                                                   \
+	case ARCH_##hl##_##nb##_##qa##_##qb##_##scale:                                                  \
+		if (nn_network_i8)                                                                          \
+			return f(*(const NetworkI8<Network<hl, nb, qa, qb, scale>> *)nn_network_i8);            \
+		return f(*(const Network<hl, nb, qa, qb, scale> *)nn_network);
+		NETWORK_ARCHS(X)
+#undef X
+	default:
+		__builtin_unreachable();
+	}
+}
+
+uint64_t network_checksum(const void *data, size_t size);
+
+void load_embedded_network();
+// Maps a network file and makes it the active network, leaving the current one in place on failure
+bool load_network_file(const std::string &path, std::string &error);
+void use_int8_network(bool enabled);
+// Whether this build has the byte lookups (AVX-512 VBMI and VNNI) that make the int8 output layer faster than int16
+bool int8_network_faster();
+std::string network_description();
+
+template <typename Net>
+void quantize_network(const Net &net, NetworkI8<Net> &out);
 
 int calculate_index(Square sq, PieceType pt, bool side, bool perspective);
 
-void accumulator_add(const Network &net, Accumulator &acc, uint16_t index);
+template <typename Net>
+void accumulator_add(const Net &net, typename Net::Accumulator &acc, uint16_t index);
+
+template <typename Net>
+void accumulator_sub(const Net &net, typename Net::Accumulator &acc, uint16_t index);
+
+// Rebuilds both accumulators from scratch given the active feature indices of each perspective
+template <typename Net>
+void accumulator_refresh(const Net &net, typename Net::Accumulator &w_acc, typename Net::Accumulator &b_acc, const uint16_t *w_idx, const uint16_t *b_idx, int n);
+
+// Copies src into dst while applying a feature delta
+template <typename Net>
+void accumulator_update(const Net &net, const typename Net::Accumulator &src, typename Net::Accumulator &dst, const uint16_t *add, int nadd, const uint16_t *sub, int nsub);
+
+// Runs the output layer on n positions at once, out[i] is from the perspective of stm[i]
+template <typename Net>
+void nn_eval_batch(const Net &net, const typename Net::Accumulator *stm, const typename Net::Accumulator *ntm, const uint8_t *nbuckets, int n, int32_t *out);
+
+// Policy logits of n moves given by their policy indices, from the side to move's accumulator
+template <typename Net>
+void policy_logits(const Net &net, const PolicyHead<Net::HL_SIZE> &policy, const typename Net::Accumulator &stm, const uint16_t *indices, int n, float *out);
 
-void accumulator_sub(const Network &net, Accumulator &acc, uint16_t index);
+template <typename Net>
+int32_t nn_eval(const Net &net, const typename Net::Accumulator &stm, const typename Net::Accumulator &ntm, uint8_t nbucket);
 
-int32_t nn_eval(const Network &net, const Accumulator &stm, const Accumulator &ntm, uint8_t nbucket);
\ No newline at end of file
+// Output bucket of a position with npieces pieces on the board
+template <typename Net>
+constexpr uint8_t output_bucket(int npieces) {
+	return std::min((npieces - 2) / (32 / Net::NBUCKETS), Net::NBUCKETS - 1);
+}
@@ -0,0 +1,105 @@
+#include "node.hpp"
+
+NodePool node_pool;
+
+// This function is called before main()
+__attribute__((constructor)) void init_node_pool() {
+    node_pool.resize(64);
+}
+
+NodePool::~NodePool() {
+    delete[] slots;
+}
+
+void NodePool::resize(size_t mb) {
+    delete[] slots;
+    // The root always needs a node, so keep at least a handful even for tiny sizes
+    capacity = std::min<size_t>(std::max<size_t>((mb << 20) / sizeof(PoolSlot), 2), NO_SLOT);
+    slots = new PoolSlot[capacity];
+    used = capacity;
+    // Thread the free list in address order so a fresh tree is laid out sequentially
+    free_list = NO_SLOT;
+    for (size_t i = capacity; i-- > 0;)
+        give(i);
+}
+
+uint32_t NodePool::take() {
+    uint32_t index = free_list;
+    if (index == NO_SLOT)
+        return NO_SLOT;
+    memcpy(&free_list, slots[index].bytes, sizeof(free_list));
+    used++;
+    return index;
+}
+
+void NodePool::give(uint32_t index) {
+    memcpy(slots[index].bytes, &free_list, sizeof(free_list));
+    free_list = index;
+    used--;
+}
+
+MCTSNode *NodePool::alloc() {
+    uint32_t index = take();
+    if (index == NO_SLOT)
+        return nullptr;
+    return new (&slots[index]) MCTSNode();
+}
+
+void NodePool::release(MCTSNode *node) {
+    release_children(node);
+    give(reinterpret_cast<PoolSlot *>(node) - slots);
+}
+
+void NodePool::release_children(MCTSNode *node) {
+    MCTSNode *child = node->children.head;
+    while (child) {
+        // The slot is reused as soon as it is released, so step past it first
+        MCTSNode *next = child->next_sibling;
+        release(child);
+        child = next;
+    }
+    uint32_t index = node->children.edges;
+    while (index != NO_SLOT) {
+        uint32_t next = chunk(index)->next;
+        give(index);
+        index = next;
+    }
+    node->children.clear();
+}
+
+bool NodePool::store_edges(MCTSNode *node, const Edge *edges, int count) {
+    const int chunks = (count + EdgeChunk::CAPACITY - 1) / EdgeChunk::CAPACITY;
+    if (available() < (size_t)chunks)
+        return false;
+    // Built back to front so the chain ends up in edge order
+    uint32_t head = NO_SLOT;
+    for (int c = chunks - 1; c >= 0; c--) {
+        uint32_t index = take();
+        EdgeChunk *chunk = new (&slots[index]) EdgeChunk();
+        const int begin = c * EdgeChunk::CAPACITY;
+        std::copy(edges + begin, edges + std::min(count, begin + EdgeChunk::CAPACITY), chunk->edges);
+        chunk->next = head;
+        head = index;
+    }
+    node->children.edges = head;
+    node->children.total = count;
+    return true;
+}
+
+MCTSNode *NodePool::widen(MCTSNode *node) {
+    ChildList &children = node->children;
+    if (children.complete())
+        return nullptr;
+    MCTSNode *child = alloc();
+    if (!child)
+        return nullptr;
+    uint32_t index = children.edges;
+    for (int c = children.count / EdgeChunk::CAPACITY; c > 0; c--)
+        index = chunk(index)->next;
+    const Edge &edge = chunk(index)->edges[children.count % EdgeChunk::CAPACITY];
+    child->move = edge.move;
+    child->prior = edge.prior;
+    child->parent = node;
+    children.push_front(child);
+    return child;
+}
@@ -2,23 +2,153 @@
 
 #include "bitboard.hpp"
 
+#include <new>
+
+struct MCTSNode;
+
+// Marks the end of a chain of pool slots
+#define NO_SLOT UINT32_MAX
+
+// Game theoretic value of a node for the player who made its move, once the solver has established it
+enum ProofState : uint8_t { UNPROVEN, PROVEN_WIN, PROVEN_LOSS, PROVEN_DRAW };
+
+// A legal move of an expanded node and its prior, whether or not it has a node yet
+struct Edge {
+    Move move;
+    float prior;
+};
+
+// Edges of an expansion live in pool slots, chained when a position has more moves than fit in one
+struct EdgeChunk {
+    static constexpr int CAPACITY = 7;
+    Edge edges[CAPACITY];
+    uint32_t next;
+};
+
+// Children are a singly linked list of siblings so that every node has the same small size and can live in a pool
+// Expansion only stores the moves sorted by prior, nodes are created for them in that order as the search widens
+struct ChildList {
+    MCTSNode *head = nullptr;
+    uint32_t edges = NO_SLOT; // First edge chunk, NO_SLOT until the node is expanded
+    uint16_t count = 0; // Children with a node, always the first count edges
+    uint16_t total = 0; // Legal moves
+
+    struct iterator {
+        MCTSNode *node;
+        MCTSNode *operator*() const { return node; }
+        iterator &operator++();
+        bool operator!=(const iterator &other) const { return node != other.node; }
+    };
+
+    iterator begin() const { return {head}; }
+    iterator end() const { return {nullptr}; }
+    uint16_t size() const { return count; }
+    // Whether every legal move has a node
+    bool complete() const { return count == total; }
+    // Linear walk, only meant for the occasional random pick
+    MCTSNode *operator[](uint16_t index) const;
+    void push_front(MCTSNode *child);
+    void clear() {
+        head = nullptr;
+        edges = NO_SLOT;
+        count = total = 0;
+    }
+};
+
 struct MCTSNode {
     double val;
+    MCTSNode *parent;
+    MCTSNode *next_sibling;
+    ChildList children;
     int nsims;
+    float prior;
+    // All-moves-as-first statistics of this node's move, from every simulation through the parent that played it later on
+    float amaf_val;
+    int amaf_nsims;
     Move move;
-    MCTSNode *parent;
-    pzstd::vector<MCTSNode *> children;
-    double prior;
+    ProofState proven;
+    uint8_t proof_plies; // Plies until the game ends with best play, for proven nodes
 
-    MCTSNode() : val(0), nsims(0), move(NullMove), parent(nullptr), prior(1) {}
+    MCTSNode() : val(0), parent(nullptr), next_sibling(nullptr), nsims(0), prior(1), amaf_val(0), amaf_nsims(0), move(NullMove), proven(UNPROVEN), proof_plies(0) {}
 
-    inline double puctval(double c_puct = 1.414) {
-        if (nsims == 0) return 1e9; // prioritize unexplored nodes
+    // rave_k is the visit count at which the AMAF and Monte Carlo values weigh about the same, 0 disables RAVE
+    inline double puctval(double c_puct = 1.414, double rave_k = 0) {
+        const bool rave = rave_k > 0 && amaf_nsims > 0;
+        if (nsims == 0 && !rave) return 1e9; // prioritize unexplored nodes
         // PUCT formula: Q + C * P * sqrt(N) / (1 + n)
         // where Q is average value, C is exploration constant, P is prior probability,
         // N is parent visits, n is node visits
-        double q_value = (double)val / nsims;
+        double q_value = nsims ? (double)val / nsims : 0;
+        if (rave) {
+            // beta = sqrt(k / (3n + k)) hands the estimate over from AMAF to the node's own visits as n grows
+            double beta = sqrt(rave_k / (3.0 * nsims + rave_k));
+            q_value = (1 - beta) * q_value + beta * amaf_val / amaf_nsims;
+        }
         double u_value = c_puct * prior * sqrt(parent->nsims) / (1.0 + nsims);
         return q_value + u_value;
     }
-};
\ No newline at end of file
+};
+
+inline ChildList::iterator &ChildList::iterator::operator++() {
+    node = node->next_sibling;
+    return *this;
+}
+
+inline MCTSNode *ChildList::operator[](uint16_t index) const {
+    MCTSNode *node = head;
+    while (index--)
+        node = node->next_sibling;
+    return node;
+}
+
+inline void ChildList::push_front(MCTSNode *child) {
+    child->next_sibling = head;
+    head = child;
+    count++;
+}
+
+// Raw storage for either a node or an edge chunk, both are constructed in place
+struct alignas(64) PoolSlot {
+    unsigned char bytes[64];
+};
+
+static_assert(sizeof(MCTSNode) <= sizeof(PoolSlot), "a node must fit in a pool slot");
+static_assert(sizeof(EdgeChunk) <= sizeof(PoolSlot), "an edge chunk must fit in a pool slot");
+
+// Fixed budget of slots for the search tree, sized by the Hash option
+struct NodePool {
+    PoolSlot *slots = nullptr;
+    uint32_t free_list = NO_SLOT; // Free slots store the index of the next one in their first bytes
+    size_t capacity = 0, used = 0;
+
+    ~NodePool();
+
+    // Size is in MB, all nodes must have been released
+    void resize(size_t mb);
+
+    // Returns nullptr when the pool is exhausted
+    MCTSNode *alloc();
+    void release(MCTSNode *node);
+    // Releases every descendant of node and its edges, leaving it a leaf
+    void release_children(MCTSNode *node);
+
+    // Stores the moves of node, which must be a leaf, returns false when the pool cannot hold them
+    bool store_edges(MCTSNode *node, const Edge *edges, int count);
+    // Creates the node of the first edge of node that has none yet, returns nullptr when the pool is exhausted
+    MCTSNode *widen(MCTSNode *node);
+
+    EdgeChunk *chunk(uint32_t index) const {
+        return std::launder(reinterpret_cast<EdgeChunk *>(&slots[index]));
+    }
+
+    size_t available() const { return capacity - used; }
+    size_t memory() const { return used * sizeof(PoolSlot); }
+    // Permille of the pool in use, as reported by `info hashfull`
+    int hashfull() const { return capacity ? used * 1000 / capacity : 0; }
+
+private:
+    uint32_t take();
+    void give(uint32_t index);
+};
+
+extern NodePool node_pool;
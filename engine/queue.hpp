@@ -0,0 +1,85 @@
+#pragma once
+
+#include "includes.hpp"
+
+#include <atomic>
+
+// Bounded lock-free queue for any number of producers and consumers (Vyukov)
+// Every cell carries a sequence number that tells producers and consumers whose turn it is, so neither side ever blocks
+template <typename T>
+struct BoundedQueue {
+	struct alignas(64) Cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	Cell *cells = nullptr;
+	size_t mask = 0;
+	alignas(64) std::atomic<size_t> head{0}; // Next cell to pop
+	alignas(64) std::atomic<size_t> tail{0}; // Next cell to push
+
+	~BoundedQueue() {
+		delete[] cells;
+	}
+
+	// Capacity is rounded up to a power of two, the queue must be empty and unused while resizing
+	void resize(size_t capacity) {
+		delete[] cells;
+		capacity = std::max<size_t>(2, capacity);
+		capacity = 1ULL << (64 - _lzcnt_u64(capacity - 1));
+		cells = new Cell[capacity];
+		mask = capacity - 1;
+		for (size_t i = 0; i < capacity; i++)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+	}
+
+	// Returns false when the queue is full
+	bool push(const T &item) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		while (true) {
+			Cell &cell = cells[pos & mask];
+			const size_t seq = cell.seq.load(std::memory_order_acquire);
+			const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.data = item;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Returns false when the queue is empty
+	bool pop(T &item) {
+		size_t pos = head.load(std::memory_order_relaxed);
+		while (true) {
+			Cell &cell = cells[pos & mask];
+			const size_t seq = cell.seq.load(std::memory_order_acquire);
+			const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					item = cell.data;
+					cell.seq.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Only a snapshot, other threads may change it right away
+	size_t size() const {
+		const size_t t = tail.load(std::memory_order_relaxed), h = head.load(std::memory_order_relaxed);
+		return t > h ? t - h : 0;
+	}
+};
@@ -14,6 +14,11 @@ struct fast_random {
 		return state * 0x2545F4914F6C21C6ULL; // Multiply by a large prime
 	}
 
+	// Uniform in (0, 1), never exactly 0 or 1
+	double next_double() {
+		return ((next() >> 11) + 0.5) * 0x1.0p-53;
+	}
+
 	int next_int(int min, int max) {
 		return (int)(next() % (max - min + 1)) + min;
 	}
@@ -0,0 +1,78 @@
+#include "reporter.hpp"
+
+#include <sstream>
+
+InfoReporter info_reporter;
+
+std::string uci_score(const PVLine &line) {
+	const int plies = line.proof_plies + 1;
+	if (line.proven == PROVEN_WIN)
+		return "mate " + std::to_string((plies + 1) / 2);
+	if (line.proven == PROVEN_LOSS)
+		return "mate -" + std::to_string(plies / 2);
+	return "cp " + std::to_string(line.cp);
+}
+
+std::string format_info(const InfoSnapshot &snapshot) {
+	std::ostringstream out;
+	const int64_t elapsed = std::max<int64_t>(snapshot.elapsed, 1);
+	for (size_t i = 0; i < snapshot.lines.size(); i++) {
+		const PVLine &line = snapshot.lines[i];
+		out << "info depth " << snapshot.nodes / 10000 + 1 << " multipv " << i + 1 << " score " << uci_score(line);
+		out << " nodes " << snapshot.nodes << " nps " << snapshot.nodes * 1000 / elapsed << " hashfull " << snapshot.hashfull << " time " << elapsed << " pv";
+		for (int ply = 0; ply < line.len; ply++)
+			out << ' ' << line.pv[ply].to_string();
+		out << '\n';
+	}
+	for (size_t i = 0; i < snapshot.lines.size(); i++) {
+		const PVLine &line = snapshot.lines[i];
+		out << "info string multipv " << i + 1 << " move " << line.move.to_string() << " visits " << line.visits;
+		out << " q " << std::fixed << std::setprecision(4) << line.q << std::defaultfloat << '\n';
+	}
+	return out.str();
+}
+
+void InfoReporter::start() {
+	stopping = ready = false;
+	requested.store(false, std::memory_order_relaxed);
+	thread = std::thread(&InfoReporter::run, this);
+}
+
+void InfoReporter::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	cv.notify_all();
+	if (thread.joinable())
+		thread.join();
+	requested.store(false, std::memory_order_relaxed);
+}
+
+void InfoReporter::publish(InfoSnapshot &snapshot) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::swap(pending, snapshot);
+		ready = true;
+	}
+	requested.store(false, std::memory_order_relaxed);
+	cv.notify_all();
+}
+
+void InfoReporter::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		if (cv.wait_for(lock, std::chrono::milliseconds(interval), [this] { return stopping; }))
+			return;
+		requested.store(true, std::memory_order_relaxed);
+		cv.wait(lock, [this] { return ready || stopping; });
+		if (!ready)
+			return;
+		ready = false;
+		std::swap(pending, shown);
+		// Formatting and writing happen outside the lock, the tree thread can publish again meanwhile
+		lock.unlock();
+		std::cout << format_info(shown) << std::flush;
+		lock.lock();
+	}
+}
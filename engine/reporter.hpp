@@ -0,0 +1,65 @@
+#pragma once
+
+#include "includes.hpp"
+
+#include "move.hpp"
+#include "node.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr int MAX_PV_PLIES = 64;
+
+// A root move as reported to the GUI, copied out of the tree so that another thread can format it
+struct PVLine {
+	Move move;
+	int visits;
+	int cp; // Same rounding as the eval printed with bestmove
+	double q; // Mean value for the player making move
+	ProofState proven;
+	uint8_t proof_plies;
+	int len;
+	Move pv[MAX_PV_PLIES];
+};
+
+// Root statistics at one point of a search
+struct InfoSnapshot {
+	int64_t nodes = 0, elapsed = 1;
+	int hashfull = 0;
+	std::vector<PVLine> lines; // Best first
+};
+
+// UCI score of a root move, `mate N` once the solver has decided it
+std::string uci_score(const PVLine &line);
+// One `info ... multipv i ...` line per line of the snapshot, then an `info string` with the visits and Q of each
+std::string format_info(const InfoSnapshot &snapshot);
+
+// Prints the info lines of a running search every interval ms from its own thread
+// The tree thread polls due() and answers with publish(), so the only cost to the search is filling in a snapshot
+struct InfoReporter {
+	int64_t interval = 1000;
+
+	void start();
+	void stop();
+
+	bool due() const {
+		return requested.load(std::memory_order_relaxed);
+	}
+	// Hands snapshot over to the reporter thread, it is left with an older snapshot to fill in next time
+	void publish(InfoSnapshot &snapshot);
+
+private:
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::atomic<bool> requested{false};
+	bool stopping = false, ready = false;
+	InfoSnapshot pending, shown;
+
+	void run();
+};
+
+extern InfoReporter info_reporter;
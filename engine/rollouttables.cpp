@@ -0,0 +1,18 @@
+#include "rollouttables.hpp"
+
+RolloutTables rollout_tables;
+
+void RolloutTables::clear() {
+	decay(0);
+}
+
+void RolloutTables::decay(float factor) {
+	for (MoveStats &m : mast[0])
+		m.scale(factor);
+	for (MoveStats &m : mast[1])
+		m.scale(factor);
+	for (MoveStats &m : nst[0])
+		m.scale(factor);
+	for (MoveStats &m : nst[1])
+		m.scale(factor);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "includes.hpp"
+
+#include "move.hpp"
+
+#include <atomic>
+
+// Log2 of the entries in the move pair table
+#define NST_BITS 18
+#define NST_SIZE (1 << NST_BITS)
+// Visits a move pair needs before NST trusts it over the single move average
+#define NST_MIN_VISITS 7
+
+// Running total of the results of a move, from the perspective of the player making it
+// Only the tree thread writes, rollout workers read concurrently, so relaxed atomics (plain moves on x86) are enough
+struct MoveStats {
+	std::atomic<float> val{0};
+	std::atomic<float> n{0};
+
+	void add(float score) {
+		val.store(val.load(std::memory_order_relaxed) + score, std::memory_order_relaxed);
+		n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	void scale(float factor) {
+		val.store(val.load(std::memory_order_relaxed) * factor, std::memory_order_relaxed);
+		n.store(n.load(std::memory_order_relaxed) * factor, std::memory_order_relaxed);
+	}
+};
+
+// Online learned rollout policy tables: move averages (MAST) and move pair averages (NST)
+// Both are indexed by the side to move and Move::data without verification, colliding moves just share their statistics
+// The same pair means opposite things for the two sides, so each side has its own NST table as well
+struct RolloutTables {
+	MoveStats mast[2][1 << 16];
+	MoveStats nst[2][NST_SIZE];
+
+	void clear();
+	// Scales every entry down so old searches fade out without being forgotten outright
+	void decay(float factor);
+
+	// prev is the move played just before move, score is from side's perspective
+	void update(bool side, Move prev, Move move, float score) {
+		mast[side][move.data].add(score);
+		nst[side][pair_index(prev, move)].add(score);
+	}
+
+	// Averages shrink towards a draw while they have few samples
+	float mast_value(bool side, Move move) const {
+		const MoveStats &m = mast[side][move.data];
+		return m.val.load(std::memory_order_relaxed) / (m.n.load(std::memory_order_relaxed) + 1);
+	}
+	float nst_value(bool side, Move prev, Move move) const {
+		const float single = mast_value(side, move);
+		const MoveStats &p = nst[side][pair_index(prev, move)];
+		const float n = p.n.load(std::memory_order_relaxed);
+		if (n < NST_MIN_VISITS)
+			return single;
+		return (single + p.val.load(std::memory_order_relaxed) / n) / 2;
+	}
+
+	static inline uint32_t pair_index(Move prev, Move move) {
+		return (((uint32_t)prev.data << 16 | move.data) * 0x9e3779b1u) >> (32 - NST_BITS);
+	}
+};
+
+extern RolloutTables rollout_tables;
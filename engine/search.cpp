@@ -1,24 +1,147 @@
 #include "search.hpp"
+#include "queue.hpp"
 #include <algorithm>
+#include <vector>
 
-int games = 0, limit = 50000, last_check = 0;
-clock_t start;
-int max_time = 0;
+int games = 0;
+TimeManager tm;
+std::atomic<bool> stop_flag(false); // Raised by `stop` or the hard deadline timer
 double c_puct = 1.414; // PUCT exploration constant
+bool value_priors = true; // Shape priors with a batched NNUE evaluation of the children
+constexpr double VALUE_PRIOR_TEMP = 150; // Softmax temperature of the child evaluations, in centipawns
+bool policy_priors = true; // Use the network's policy head instead of score_move when it has one
+constexpr double POLICY_TEMP = 1; // Softmax temperature of the policy logits
+RolloutMode rollout_mode = ROLLOUT_HYBRID;
+constexpr int ROLLOUT_PLIES = 8; // Random plies played by a hybrid rollout before resolving captures
+constexpr int RESOLVE_PLIES = 16; // Cap on the capture resolution that follows
+// Rollout statistics of the current search, per thread until the workers merge theirs into worker_stats
+thread_local uint64_t rollouts = 0, rollout_plies = 0;
+bool adjudication = true; // End rollouts early in dead drawn or clearly decided positions
+constexpr Value ADJUDICATE_MATERIAL = 1500; // Material lead that counts as a won rollout
+constexpr double ADJUDICATE_EVAL = 0.2; // Eval lead (in eval() units, 2000cp) that counts as a won rollout
+constexpr int ADJUDICATE_EVAL_INTERVAL = 8; // Random rollouts only pay for an eval every this many plies
+thread_local uint64_t adjudicated = 0;
+constexpr int TIME_UPDATE_INTERVAL = 256; // Simulations between time manager updates
+bool gumbel = false; // Gumbel top-k sampling with sequential halving at the root, improved policy below it
+constexpr int GUMBEL_K = 16; // Root moves sampled for sequential halving
+constexpr int64_t GUMBEL_UNLIMITED_BUDGET = 50000; // Halving budget of a search with neither a node nor a time limit
+constexpr double GUMBEL_C_VISIT = 50, GUMBEL_C_SCALE = 0.1; // Scale of the value term, as in Gumbel MuZero
+bool rave = false; // Blend all-moves-as-first statistics into the selection value
+constexpr double RAVE_EQUIV = 300; // Visits at which a node's own value and its AMAF value weigh about the same
+constexpr int MAX_ROLLOUT_MOVES = 512; // Moves recorded per rollout, longer random games only credit their start
+constexpr int MAX_SIMULATION_MOVES = 1024; // Tree path plus rollout, simulations deeper than that are not learned from
+thread_local Move rollout_moves[MAX_ROLLOUT_MOVES]; // Moves of the current rollout, in order
+thread_local int rollout_len = 0;
+uint32_t amaf_seen[1 << 16]; // Stamped with amaf_stamp by move data, so it never needs clearing
+uint32_t amaf_stamp = 0;
+Move simulation_moves[MAX_SIMULATION_MOVES]; // Whole simulation from the root, tree path first
+RolloutPolicy rollout_policy = ROLLOUT_UNIFORM;
+constexpr double ROLLOUT_EPSILON = 0.1; // Chance of a uniformly random move under the MAST and NST policies
+constexpr float TABLE_DECAY = 0.5; // Weight the rollout tables keep from one search to the next
+bool root_side = WHITE; // Side to move at the root, moves alternate from there in simulation_moves
+Move root_prev = NullMove; // Move that led to the root, the first pair NST sees
+bool widening = true; // Progressive widening, nodes for the children of non-root nodes are created as their visits grow
+constexpr double PW_C = 2; // A node with N visits may have PW_C * sqrt(N + 1) children
+int64_t last_nps = 20000; // Used to turn a time budget into a simulation budget
+constexpr double GC_TARGET = 0.25; // Fraction of the node pool that garbage collection frees up
+int gc_runs = 0;
+int multipv = 1; // Root moves reported in every info update, best first
+std::vector<Move> root_moves; // `go searchmoves` of the current search, empty when every root move is searched
 
-fast_random rng(1);
+int threads = 1; // Search threads, every one past the first runs rollouts for the pipeline
+int pipeline_depth = 64; // Leaves in flight at once when pipelining
+constexpr int MAX_PATH = 256; // Deepest leaf a pipeline job can describe, deeper ones are simulated in place
+constexpr int VIRTUAL_LOSS = 1; // Losses charged to every node on the path of a leaf in flight
+// Reproducible searches: fixed seeds, node limits instead of the clock, and pipelined results backed up in the order
+// their leaves were issued, once pipeline_depth leaves are in flight, so the tree never depends on thread timing
+bool deterministic = false;
+constexpr uint64_t DETERMINISTIC_SEED = 0x9E3779B97F4A7C15ULL;
+constexpr int64_t DETERMINISTIC_NODES = 50000; // Node limit of a deterministic search that was only given a clock
+uint64_t signature = 0; // Hash of the root visit distribution of the last search
+// Workers read the rollout tables at whatever moment they get to a job, so a reproducible pipeline can only use
+// tables that stay put for the whole search: they then learn nothing until deterministic mode is turned off again
+bool tables_frozen = false;
+// Root position the tree thread plays deterministic rollouts on when there are no workers, null otherwise
+Board *inline_board = nullptr;
 
-void clear_nodes(MCTSNode *root) {
-    for (auto &child : root->children) {
-        clear_nodes(child);
-        delete child;
+// A leaf handed to the rollout workers: the node to back the result up from and the moves leading to it from the root
+struct LeafJob {
+    MCTSNode *leaf;
+    uint64_t seq; // Issue order
+    int depth;
+    Move path[MAX_PATH];
+};
+
+// Outcome of a LeafJob, with the rollout moves for the AMAF and rollout table updates
+struct LeafResult {
+    MCTSNode *leaf;
+    uint64_t seq;
+    double score; // For the player who made leaf->move
+    int len;
+    Move moves[MAX_ROLLOUT_MOVES];
+};
+
+BoundedQueue<LeafJob> leaf_queue;
+BoundedQueue<LeafResult> result_queue;
+std::atomic<bool> workers_done(false);
+int in_flight = 0; // Leaves queued or being rolled out, only touched by the thread that owns the tree
+std::atomic<uint64_t> worker_stats[3]; // Rollouts, rollout plies and adjudications of the finished workers
+// Pipeline telemetry, sampled by the tree thread once per iteration
+uint64_t queue_samples = 0, leaf_depth_sum = 0, result_depth_sum = 0, pipeline_stalls = 0;
+size_t leaf_depth_max = 0, result_depth_max = 0;
+// Deterministic mode keeps results that arrive early here, by seq, until it is their turn
+std::vector<LeafResult> reorder;
+std::vector<char> reorder_ready;
+uint64_t next_issue = 0, next_backup = 0;
+
+thread_local fast_random rng(1);
+
+// Children a node may have under progressive widening, the root always gets all of them
+static inline int widen_limit(MCTSNode *node, int total) {
+    if (!widening || !node->parent)
+        return total;
+    return std::min<int>(total, std::ceil(PW_C * std::sqrt(node->nsims + 1)));
+}
+
+// Releases the subtrees of the children of node with at most threshold visits
+static void prune(MCTSNode *node, int threshold) {
+    for (MCTSNode *child : node->children) {
+        if (child->children.size() == 0)
+            continue;
+        if (child->nsims <= threshold)
+            node_pool.release_children(child);
+        else
+            prune(child, threshold);
     }
-    root->children.clear();
 }
 
-int to_cp_eval(int nsims, int val) {
+static void gather_visits(MCTSNode *node, std::vector<int> &visits) {
+    for (MCTSNode *child : node->children) {
+        if (child->children.size() == 0)
+            continue;
+        visits.push_back(child->nsims);
+        gather_visits(child, visits);
+    }
+}
+
+// Turns the least visited subtrees back into leaves until GC_TARGET of the pool is free
+// Pruned nodes keep their statistics and are simply expanded again if the search comes back to them
+void collect_garbage(MCTSNode *root) {
+    std::vector<int> visits;
+    gather_visits(root, visits);
+    std::sort(visits.begin(), visits.end());
+    gc_runs++;
+    // A child never has more visits than its parent, so each threshold cuts whole subtrees off at their top
+    for (double quantile : {0.5, 0.75, 0.9, 0.97, 1.0}) {
+        if (visits.empty() || node_pool.available() >= node_pool.capacity * GC_TARGET)
+            break;
+        prune(root, visits[(size_t)(quantile * (visits.size() - 1))]);
+    }
+}
+
+int to_cp_eval(int nsims, double val) {
     if (nsims == 0) return 0;
-    return ((double)val / nsims) * 10000; // +100 = definite win, -100 = definite loss
+    return val / nsims * 10000; // +100 = definite win, -100 = definite loss
 }
 
 double score_move(Move &move, Board &board) {
@@ -46,58 +169,695 @@ double score_move(Move &move, Board &board) {
     return score;
 }
 
+// Proves the ancestors of a freshly proven node for as long as its proof decides them
+static void propagate_proof(MCTSNode *node) {
+    for (MCTSNode *parent = node->parent; parent && parent->proven == UNPROVEN; node = parent, parent = parent->parent) {
+        if (node->proven == PROVEN_WIN) {
+            // The side to move at the parent has a winning move, so whoever moved into the parent has lost
+            parent->proven = PROVEN_LOSS;
+            parent->proof_plies = std::min(node->proof_plies + 1, 255);
+            continue;
+        }
+        // Otherwise the parent is only decided once every child is, including moves without a node yet
+        if (!parent->children.complete())
+            return;
+        bool draw = false;
+        int plies = 0;
+        for (MCTSNode *child : parent->children) {
+            if (child->proven == UNPROVEN)
+                return;
+            draw |= child->proven == PROVEN_DRAW;
+            plies = std::max(plies, (int)child->proof_plies);
+        }
+        parent->proven = draw ? PROVEN_DRAW : PROVEN_WIN;
+        parent->proof_plies = std::min(plies + 1, 255);
+    }
+}
+
+// Best move at the root: the fastest proven win, else the most visited move that is not a proven loss,
+// else the loss that takes longest
+static MCTSNode *best_root_child(MCTSNode *root) {
+    MCTSNode *best = nullptr;
+    for (MCTSNode *child : root->children) {
+        if (child->proven == PROVEN_WIN && (!best || best->proven != PROVEN_WIN || child->proof_plies < best->proof_plies))
+            best = child;
+    }
+    if (best)
+        return best;
+    for (MCTSNode *child : root->children) {
+        if (child->proven != PROVEN_LOSS && (!best || child->nsims > best->nsims))
+            best = child;
+    }
+    if (best)
+        return best;
+    for (MCTSNode *child : root->children) {
+        if (!best || child->proof_plies > best->proof_plies)
+            best = child;
+    }
+    return best;
+}
+
+// Monotone transform of a completed Q value (in [-1, 1]) that grows with the visit count of the most visited sibling
+static inline double gumbel_sigma(double q, int max_visits) {
+    return (GUMBEL_C_VISIT + max_visits) * GUMBEL_C_SCALE * (q + 1) / 2;
+}
+
+// Q of a child for the player choosing it, unvisited children take the value of their parent
+static inline double completed_q(MCTSNode *node, MCTSNode *child) {
+    if (child->nsims)
+        return child->val / child->nsims;
+    return node->nsims ? -node->val / node->nsims : 0;
+}
+
+// Gumbel MuZero selection below the root: the child whose visit share lags its improved policy the most
+static MCTSNode *gumbel_select(MCTSNode *node) {
+    int max_visits = 0;
+    for (MCTSNode *child : node->children)
+        max_visits = std::max(max_visits, child->nsims);
+
+    double logits[PZSTL_MAX_SIZE], max_logit = -1e9, total = 0;
+    int i = 0;
+    for (MCTSNode *child : node->children) {
+        logits[i] = std::log(std::max<double>(child->prior, 1e-9)) + gumbel_sigma(completed_q(node, child), max_visits);
+        max_logit = std::max(max_logit, logits[i++]);
+    }
+    const int n = i;
+    for (i = 0; i < n; i++) {
+        logits[i] = std::exp(logits[i] - max_logit);
+        total += logits[i];
+    }
+
+    MCTSNode *best = nullptr;
+    double best_score = -1e9;
+    i = 0;
+    for (MCTSNode *child : node->children) {
+        double score = logits[i++] / total - (double)child->nsims / (1 + node->nsims);
+        if (child->proven == UNPROVEN && score > best_score) {
+            best_score = score;
+            best = child;
+        }
+    }
+    return best;
+}
+
+// Sequential halving over the top GUMBEL_K root moves drawn by Gumbel-top-k from the priors
+struct GumbelRoot {
+    MCTSNode *cand[GUMBEL_K];
+    double logit[GUMBEL_K]; // Log prior
+    double gumbel[GUMBEL_K]; // Gumbel sample drawn with the candidate, it stays part of its score through every halving
+    int visits[GUMBEL_K]; // Visits in the current phase
+    int m = 0, phases_left = 0, per_candidate = 0;
+    int64_t budget_left = 0;
+
+    void init(MCTSNode *root, int64_t budget) {
+        double key[GUMBEL_K];
+        m = 0;
+        for (MCTSNode *child : root->children) {
+            const double l = std::log(std::max<double>(child->prior, 1e-9));
+            const double g = -std::log(-std::log(rng.next_double()));
+            const double k = l + g;
+            // Insertion into the top-k kept in descending order of the perturbed logits
+            int pos = m < GUMBEL_K ? m++ : GUMBEL_K;
+            while (pos > 0 && key[pos - 1] < k) {
+                if (pos < GUMBEL_K) {
+                    key[pos] = key[pos - 1];
+                    logit[pos] = logit[pos - 1];
+                    gumbel[pos] = gumbel[pos - 1];
+                    cand[pos] = cand[pos - 1];
+                }
+                pos--;
+            }
+            if (pos < GUMBEL_K) {
+                key[pos] = k;
+                logit[pos] = l;
+                gumbel[pos] = g;
+                cand[pos] = child;
+            }
+        }
+        phases_left = m > 1 ? 64 - _lzcnt_u64(m - 1) : 0; // ceil(log2(m))
+        budget_left = budget;
+        start_phase();
+    }
+
+    void start_phase() {
+        per_candidate = phases_left ? std::max<int64_t>(1, budget_left / (phases_left * m)) : 0;
+        std::fill(visits, visits + m, 0);
+    }
+
+    double score(MCTSNode *root, int i, int max_visits) const {
+        return gumbel[i] + logit[i] + gumbel_sigma(completed_q(root, cand[i]), max_visits);
+    }
+
+    // Keeps the better half of the candidates
+    void halve(MCTSNode *root) {
+        int max_visits = 0;
+        for (int i = 0; i < m; i++)
+            max_visits = std::max(max_visits, cand[i]->nsims);
+        int order[GUMBEL_K];
+        for (int i = 0; i < m; i++)
+            order[i] = i;
+        std::sort(order, order + m, [&](int a, int b) { return score(root, a, max_visits) > score(root, b, max_visits); });
+        MCTSNode *c[GUMBEL_K];
+        double l[GUMBEL_K], g[GUMBEL_K];
+        for (int i = 0; i < m; i++) {
+            c[i] = cand[order[i]];
+            l[i] = logit[order[i]];
+            g[i] = gumbel[order[i]];
+        }
+        m = std::max(1, m / 2);
+        std::copy(c, c + m, cand);
+        std::copy(l, l + m, logit);
+        std::copy(g, g + m, gumbel);
+        phases_left--;
+        start_phase();
+    }
+
+    // Next root child to simulate, or nullptr once halving is over
+    MCTSNode *next(MCTSNode *root) {
+        while (phases_left > 0) {
+            int pick = -1;
+            for (int i = 0; i < m; i++) {
+                if (visits[i] < per_candidate && cand[i]->proven == UNPROVEN && (pick < 0 || visits[i] < visits[pick]))
+                    pick = i;
+            }
+            if (pick >= 0) {
+                visits[pick]++;
+                budget_left--;
+                return cand[pick];
+            }
+            halve(root);
+        }
+        return nullptr;
+    }
+
+    MCTSNode *best(MCTSNode *root) const {
+        int max_visits = 0, pick = 0;
+        for (int i = 0; i < m; i++)
+            max_visits = std::max(max_visits, cand[i]->nsims);
+        for (int i = 1; i < m; i++) {
+            if (score(root, i, max_visits) > score(root, pick, max_visits))
+                pick = i;
+        }
+        return m ? cand[pick] : nullptr;
+    }
+};
+
+// Whether root child a ranks above b, in the order of best_root_child: fastest proven wins, then visits,
+// then the slowest proven losses
+static bool ranks_above(MCTSNode *a, MCTSNode *b) {
+    const int ta = a->proven == PROVEN_WIN ? 0 : a->proven == PROVEN_LOSS ? 2 : 1;
+    const int tb = b->proven == PROVEN_WIN ? 0 : b->proven == PROVEN_LOSS ? 2 : 1;
+    if (ta != tb)
+        return ta < tb;
+    if (ta == 0)
+        return a->proof_plies < b->proof_plies;
+    if (ta == 2)
+        return a->proof_plies > b->proof_plies;
+    return a->nsims > b->nsims;
+}
+
+// Copies a root child into line, with a principal variation that follows the most visited child below it
+static void fill_line(MCTSNode *child, PVLine &line) {
+    line.move = child->move;
+    line.visits = child->nsims;
+    line.cp = to_cp_eval(child->nsims, child->val);
+    line.q = child->nsims ? child->val / child->nsims : 0;
+    line.proven = child->proven;
+    line.proof_plies = child->proof_plies;
+    line.len = 0;
+    for (MCTSNode *node = child; node && line.len < MAX_PV_PLIES;) {
+        line.pv[line.len++] = node->move;
+        MCTSNode *next = nullptr;
+        for (MCTSNode *grandchild : node->children) {
+            if (!next || grandchild->nsims > next->nsims)
+                next = grandchild;
+        }
+        node = next && next->nsims ? next : nullptr;
+    }
+}
+
+// Root statistics with the multipv best root moves
+static void take_snapshot(MCTSNode *root, InfoSnapshot &snapshot) {
+    MCTSNode *ranked[PZSTL_MAX_SIZE];
+    int n = 0;
+    for (MCTSNode *child : root->children)
+        ranked[n++] = child;
+    const int shown = std::min(n, multipv);
+    std::partial_sort(ranked, ranked + shown, ranked + n, ranks_above);
+    snapshot.nodes = games;
+    snapshot.elapsed = tm.elapsed();
+    snapshot.hashfull = node_pool.hashfull();
+    snapshot.lines.resize(shown);
+    for (int i = 0; i < shown; i++)
+        fill_line(ranked[i], snapshot.lines[i]);
+}
+
 int ngames() {
     return games;
 }
 
-std::pair<Move, Value> search(Board &board, int time, int side) {
-    games = last_check = 0;
-    start = clock();
-    max_time = time;
+uint64_t search_signature() {
+    return signature;
+}
 
-    MCTSNode *root = new MCTSNode();
-    root->parent = nullptr;
-    root->val = 0;
-    root->nsims = 0;
-    root->move = NullMove;
-    root->children.clear();
+// Seed of the rollout of the leaf issued seq-th, so a job plays out the same whichever worker takes it (splitmix64)
+static inline uint64_t job_seed(uint64_t seq) {
+    uint64_t z = DETERMINISTIC_SEED + (seq + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (z ^ (z >> 31)) | 1;
+}
 
-    while (games < limit) {
-        if (games - last_check >= 1000) {
-            if ((clock() - start) / CLOCKS_PER_MS > max_time) {
-                break;
+// FNV-1a over the moves and visit counts of the root children, in tree order
+static uint64_t root_signature(MCTSNode *root) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (MCTSNode *child : root->children) {
+        for (uint64_t word : {(uint64_t)child->move.data, (uint64_t)child->nsims}) {
+            hash ^= word;
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    return hash;
+}
+
+void stop_search() {
+    stop_flag.store(true, std::memory_order_relaxed);
+}
+
+void clear_stop() {
+    stop_flag.store(false, std::memory_order_relaxed);
+}
+
+static void select_pipelined(MCTSNode *node, Board &board);
+static int collect_results();
+static void back_up_oldest();
+static void play_inline();
+static void drain_pipeline();
+static void rollout_worker(Board board, uint64_t seed);
+
+std::pair<Move, Value> search(Board &board, const SearchLimits &search_limits, bool online) {
+    SearchLimits limits = search_limits;
+    if (deterministic) {
+        // Nodes end the search, the clock only gets a say through the hard deadline so a game is never lost on time
+        if (limits.nodes < 0 && !limits.infinite)
+            limits.nodes = DETERMINISTIC_NODES;
+        rng.state = DETERMINISTIC_SEED;
+    }
+    games = 0;
+    root_moves = limits.searchmoves;
+    rollouts = rollout_plies = adjudicated = 0;
+    for (auto &stat : worker_stats)
+        stat = 0;
+    eval_cache.reset_stats();
+    tm.init(limits, board.side, online);
+    if (deterministic) {
+        tm.dynamic = false;
+        tm.soft = tm.hard;
+    }
+    root_side = board.side;
+    root_prev = board.move_hist.empty() ? NullMove : board.move_hist.top().move();
+    if (rollout_policy != ROLLOUT_UNIFORM)
+        rollout_tables.decay(TABLE_DECAY);
+    tm.start_timer(stop_flag);
+
+    MCTSNode *root = node_pool.alloc();
+    gc_runs = 0;
+    Move last_best = NullMove;
+    bool early_stop = false;
+
+    // Pipelining keeps this thread on tree work and hands the rollouts to threads - 1 workers
+    // A deterministic search pipelines even without workers, playing the rollouts itself, so it builds the same tree
+    const bool pipelined = threads > 1 || deterministic;
+    inline_board = pipelined && threads == 1 ? &board : nullptr;
+    tables_frozen = deterministic;
+    std::vector<std::thread> workers;
+    queue_samples = leaf_depth_sum = result_depth_sum = pipeline_stalls = 0;
+    leaf_depth_max = result_depth_max = 0;
+    if (pipelined) {
+        leaf_queue.resize(pipeline_depth);
+        result_queue.resize(pipeline_depth);
+        next_issue = next_backup = 0;
+        if (deterministic) {
+            // seq of the leaves in flight spans less than pipeline_depth, so a power of two ring that large never collides
+            const size_t ring = 1ULL << (64 - _lzcnt_u64(std::max(pipeline_depth, 2) - 1));
+            reorder.resize(ring);
+            reorder_ready.assign(ring, false);
+        }
+        workers_done = false;
+        // Deterministic workers reseed for every job, drawing their seeds here would shift this thread's stream with the thread count
+        for (int i = 1; i < threads; i++)
+            workers.emplace_back(rollout_worker, board, deterministic ? job_seed(i) : rng.next() | 1);
+    }
+    int64_t next_update = TIME_UPDATE_INTERVAL;
+    // Only ever touched by this thread, publishing swaps it with the one the reporter printed last
+    static InfoSnapshot snapshot;
+    info_reporter.start();
+
+    GumbelRoot gumbel_root;
+    if (gumbel) {
+        // Expand the root first so there are priors to sample from
+        select(root, board);
+        // An infinite search has no budget to spread, halving over a fixed one still gives every candidate real visits
+        int64_t budget = limits.nodes > 0 ? limits.nodes : tm.limited ? tm.planned * last_nps / 1000 : GUMBEL_UNLIMITED_BUDGET;
+        gumbel_root.init(root, std::max<int64_t>(budget - games, 0));
+    }
+
+    while (!stop_flag.load(std::memory_order_relaxed)) {
+        if (pipelined) {
+            const size_t leaves = leaf_queue.size(), results = result_queue.size();
+            queue_samples++;
+            leaf_depth_sum += leaves;
+            result_depth_sum += results;
+            leaf_depth_max = std::max(leaf_depth_max, leaves);
+            result_depth_max = std::max(result_depth_max, results);
+            collect_results();
+        }
+        // Leaves in flight count towards the node limit, their results are on the way
+        if (limits.nodes >= 0 && games + in_flight >= limits.nodes)
+            break;
+        // Nothing left to search once the root is solved, but infinite searches must wait for `stop`
+        if (root->proven != UNPROVEN && !limits.infinite)
+            break;
+        // steady_clock is a vDSO call, cheap enough to check after every simulation
+        if (tm.soft_expired())
+            break;
+        if (pipelined && in_flight >= pipeline_depth) {
+            if (deterministic) {
+                // The oldest leaf is always the one backed up here, whenever its result actually came in
+                if (!reorder_ready[next_backup & (reorder.size() - 1)])
+                    pipeline_stalls++;
+                back_up_oldest();
+                continue;
+            }
+            // Every worker is busy, the rollouts are the bottleneck
+            pipeline_stalls++;
+            std::this_thread::yield();
+            continue;
+        }
+        if (games >= next_update && !gumbel && !deterministic) {
+            next_update = games + TIME_UPDATE_INTERVAL;
+            // Two most visited root children
+            MCTSNode *first = nullptr, *second = nullptr;
+            for (MCTSNode *child : root->children) {
+                if (!first || child->nsims > first->nsims) {
+                    second = first;
+                    first = child;
+                } else if (!second || child->nsims > second->nsims) {
+                    second = child;
+                }
             }
-            last_check = games;
-            if (games%3000==0) {
-                std::cout << "info depth " << games/10000+1 << " time " << (clock() - start) / CLOCKS_PER_MS << " nodes " << games << " score cp " << -to_cp_eval(root->nsims, root->val) << " nps " << (int)(games / ((double)(clock() - start) / CLOCKS_PER_SEC));
-                std::cout << " pv ";
-                Move best_move;
-                int most_visited = 0;
-                for (auto &child : root->children) {
-                    if (child->nsims > most_visited) {
-                        most_visited = child->nsims;
-                        best_move = child->move;
-                    }
+            if (first) {
+                bool changed = first->move != last_best;
+                last_best = first->move;
+                if (tm.update(games, first->nsims, second ? second->nsims : 0, changed)) {
+                    early_stop = true;
+                    break;
                 }
-                std::cout << best_move.to_string() << std::endl;
             }
         }
-        select(root, board);
+        if (info_reporter.due()) {
+            take_snapshot(root, snapshot);
+            info_reporter.publish(snapshot);
+        }
+        // Make sure the next expansion fits, a position has at most PZSTL_MAX_SIZE moves
+        if (node_pool.available() < PZSTL_MAX_SIZE) {
+            // Pruning must not pull nodes out from under a leaf in flight
+            drain_pipeline();
+            collect_garbage(root);
+        }
+        // Sequential halving forces the root move, plain PUCT takes over once it is done
+        MCTSNode *forced = gumbel ? gumbel_root.next(root) : nullptr;
+        if (pipelined)
+            select_pipelined(forced ? forced : root, board);
+        else if (forced)
+            select(forced, board);
+        else
+            select(root, board);
+    }
+
+    info_reporter.stop();
+    if (pipelined) {
+        drain_pipeline();
+        workers_done.store(true, std::memory_order_release);
+        for (std::thread &worker : workers)
+            worker.join();
+        rollouts += worker_stats[0];
+        rollout_plies += worker_stats[1];
+        adjudicated += worker_stats[2];
+        std::cout << "info string pipeline workers " << threads - 1 << " depth " << pipeline_depth;
+        std::cout << " leaf queue avg " << (queue_samples ? (double)leaf_depth_sum / queue_samples : 0.0) << " max " << leaf_depth_max;
+        std::cout << " result queue avg " << (queue_samples ? (double)result_depth_sum / queue_samples : 0.0) << " max " << result_depth_max;
+        std::cout << " stalls " << pipeline_stalls << std::endl;
+    }
+
+    signature = root_signature(root);
+    if (deterministic && tm.hard_expired())
+        std::cout << "info string deterministic search stopped by the clock after " << games << " nodes, the result is not reproducible" << std::endl;
+    take_snapshot(root, snapshot);
+    std::cout << format_info(snapshot);
+    MCTSNode *best = best_root_child(root);
+    // A proof beats anything the halving found
+    if (gumbel && gumbel_root.m && (!best || best->proven == UNPROVEN))
+        best = gumbel_root.best(root);
+    Move best_move = best ? best->move : NullMove;
+    Value best_val = best ? to_cp_eval(best->nsims, best->val) : 0;
+    if (best && best->proven == PROVEN_WIN)
+        best_val = VALUE_MATE - (best->proof_plies + 1);
+    else if (best && best->proven == PROVEN_LOSS)
+        best_val = -(VALUE_MATE - (best->proof_plies + 1));
+    if (best && best->proven != UNPROVEN) {
+        PVLine line;
+        fill_line(best, line);
+        std::cout << "info string solved " << best_move.to_string() << " score " << uci_score(line) << std::endl;
+    }
+    eval_cache.merge_stats();
+    uint64_t probes = eval_cache.probes.load(std::memory_order_relaxed);
+    uint64_t hits = eval_cache.hits.load(std::memory_order_relaxed);
+    std::cout << "info string evalcache hits " << hits << " probes " << probes << " hitrate " << (probes ? 100.0 * hits / probes : 0.0) << "%" << std::endl;
+    std::cout << "info string rollouts " << rollouts << " average length " << (rollouts ? (double)rollout_plies / rollouts : 0.0) << " plies adjudicated " << adjudicated << std::endl;
+
+    last_nps = std::max<int64_t>(1000, games * 1000 / std::max<int64_t>(tm.elapsed(), 1));
+    if (tm.limited)
+        std::cout << "info string time used " << tm.elapsed() << "ms planned " << tm.planned << "ms" << (early_stop ? " (stopped early)" : "") << std::endl;
+    std::cout << "info string tree slots " << node_pool.used << " memory " << node_pool.memory() / (1 << 20) << "MB gc runs " << gc_runs << std::endl;
+
+    tm.stop_timer();
+    clear_stop();
+    node_pool.release(root);
+    return {best_move, best_val};
+}
+
+// Child to descend into: widens the node as far as its visits allow, then picks by PUCT or the Gumbel improved policy
+static MCTSNode *choose_child(MCTSNode *node) {
+    // Give the next best move a node once the visits allow for it
+    while (node->children.count < widen_limit(node, node->children.total) && node_pool.widen(node))
+        ;
+
+    MCTSNode *best_child = nullptr;
+    if (gumbel) {
+        best_child = gumbel_select(node);
+    } else {
+        double best_puct = -1e9;
+        for (MCTSNode *child : node->children) {
+            // Proven children have nothing left to learn from simulations
+            if (child->proven != UNPROVEN)
+                continue;
+            double puct = child->puctval(c_puct, rave ? RAVE_EQUIV : 0);
+            if (puct > best_puct) {
+                best_puct = puct;
+                best_child = child;
+            }
+        }
+    }
+
+    // Every child with a node is proven but the node is not, so widen past the schedule
+    if (!best_child)
+        best_child = node_pool.widen(node);
+    return best_child;
+}
+
+// Plays out the position under the current rollout mode, same score convention as simulate()
+static double rollout(Board &board) {
+    if (rollout_mode != ROLLOUT_BATCH)
+        return simulate(board);
+    // The lanes are averaged into one low variance result, backing them up as separate visits skews the tree
+    double scores[BATCH_LANES], sum = 0;
+    batch_rollout(board, ROLLOUT_PLIES, rng, scores, rollout_plies);
+    rollouts += BATCH_LANES;
+    rollout_len = 0;
+    for (double score : scores)
+        sum += score;
+    return sum / BATCH_LANES;
+}
+
+// Charges (sign 1) or refunds (sign -1) a virtual loss to the player who made each move on the path to node
+// Leaves in flight then look worse to every selection passing through them, which spreads the pipeline over the tree
+static void virtual_loss(MCTSNode *node, int sign) {
+    for (; node; node = node->parent) {
+        node->nsims += sign * VIRTUAL_LOSS;
+        node->val -= sign * VIRTUAL_LOSS;
+    }
+}
+
+// Pipelined counterpart of select(): walks down to a leaf and queues it for the rollout workers
+// Terminal leaves and leaves deeper than MAX_PATH are still simulated in place
+static void select_pipelined(MCTSNode *node, Board &board) {
+    static LeafJob job; // Only ever used by the thread that owns the tree
+    int made = 0;
+    MCTSNode *leaf = nullptr;
+    job.depth = 0;
+    while (true) {
+        if (node->move != NullMove) {
+            board.make_move(node->move);
+            if (made < MAX_PATH)
+                job.path[made] = node->move;
+            made++;
+        }
+        if (node->children.size() > 0) {
+            node = choose_child(node);
+            if (!node)
+                break;
+            continue;
+        }
+        expand(node, board);
+        if (node->children.size() > 0) {
+            leaf = node->children[rng.next() % node->children.size()];
+        } else {
+            // Terminal node, nothing for a worker to do
+            double score = -simulate(board);
+            backpropagate(node, score);
+            games++;
+            if (node->proven != UNPROVEN)
+                propagate_proof(node);
+        }
+        break;
+    }
+
+    if (leaf && made < MAX_PATH) {
+        job.path[made] = leaf->move;
+        job.depth = made + 1;
+        job.leaf = leaf;
+        job.seq = next_issue++;
+        virtual_loss(leaf, 1);
+        // The caller keeps in_flight below the queue capacity, so this never spins for long
+        while (!leaf_queue.push(job))
+            std::this_thread::yield();
+        in_flight++;
+    } else if (leaf) {
+        board.make_move(leaf->move);
+        double score = -rollout(board);
+        board.unmake_move();
+        backpropagate(leaf, score);
+        games++;
+    }
+    while (made--)
+        board.unmake_move();
+}
+
+static void back_up(const LeafResult &result) {
+    virtual_loss(result.leaf, -1);
+    std::copy(result.moves, result.moves + result.len, rollout_moves);
+    rollout_len = result.len;
+    backpropagate(result.leaf, result.score);
+    games++;
+    in_flight--;
+}
+
+// Takes every finished rollout out of the result queue and returns how many there were
+// They are backed up right away, except in deterministic mode where they wait in the reorder ring for their turn
+static int collect_results() {
+    static LeafResult result;
+    int n = 0;
+    while (result_queue.pop(result)) {
+        if (deterministic) {
+            const size_t slot = result.seq & (reorder.size() - 1);
+            reorder[slot] = result;
+            reorder_ready[slot] = true;
+        } else {
+            back_up(result);
+        }
+        n++;
     }
+    return n;
+}
+
+// Deterministic mode: backs up the oldest leaf in flight, waiting for its rollout if need be
+static void back_up_oldest() {
+    const size_t slot = next_backup & (reorder.size() - 1);
+    while (!reorder_ready[slot]) {
+        if (collect_results())
+            continue;
+        if (inline_board)
+            play_inline();
+        else
+            std::this_thread::yield();
+    }
+    reorder_ready[slot] = false;
+    next_backup++;
+    back_up(reorder[slot]);
+}
+
+// Waits until every leaf in flight has been backed up, the tree can be restructured safely afterwards
+static void drain_pipeline() {
+    while (in_flight > 0) {
+        if (deterministic)
+            back_up_oldest();
+        else if (!collect_results())
+            std::this_thread::yield();
+    }
+}
+
+// Plays out the leaf of job from board, which is left at the root position it started from
+static void play_job(Board &board, const LeafJob &job, LeafResult &result) {
+    const bool learn = rave || rollout_policy != ROLLOUT_UNIFORM;
+    if (deterministic)
+        rng.state = job_seed(job.seq);
+    for (int i = 0; i < job.depth; i++)
+        board.make_move(job.path[i]);
+    result.leaf = job.leaf;
+    result.seq = job.seq;
+    result.score = -rollout(board);
+    for (int i = 0; i < job.depth; i++)
+        board.unmake_move();
+    result.len = learn ? rollout_len : 0;
+    std::copy(rollout_moves, rollout_moves + result.len, result.moves);
+}
+
+// Deterministic mode without workers: the tree thread plays the oldest job itself, straight into the reorder ring
+static void play_inline() {
+    static LeafJob job;
+    if (!leaf_queue.pop(job))
+        return;
+    // The job's seed must not shift the tree thread's own stream
+    const uint64_t state = rng.state;
+    const size_t slot = job.seq & (reorder.size() - 1);
+    play_job(*inline_board, job, reorder[slot]);
+    reorder_ready[slot] = true;
+    rng.state = state;
+}
 
-    Move best_move;
-    Value best_val = -VALUE_MAX;
-    int most_visited = 0;
-    for (auto &child : root->children) {
-        if (child->nsims > most_visited) {
-            most_visited = child->nsims;
-            best_move = child->move;
-            best_val = child->val;
+// Rollout stage of the pipeline, plays the leaves of leaf_queue on its own copy of the root position
+static void rollout_worker(Board board, uint64_t seed) {
+    rng.state = seed;
+    rollouts = rollout_plies = adjudicated = 0;
+    LeafJob job;
+    std::unique_ptr<LeafResult> result(new LeafResult);
+    while (true) {
+        if (!leaf_queue.pop(job)) {
+            // The tree thread drains the pipeline before it says it is done, so an empty queue is final then
+            if (workers_done.load(std::memory_order_acquire))
+                break;
+            std::this_thread::yield();
+            continue;
         }
+        play_job(board, job, *result);
+        while (!result_queue.push(*result))
+            std::this_thread::yield();
     }
-    clear_nodes(root);
-    delete root;
-    return {best_move, to_cp_eval(most_visited, best_val)};
+    worker_stats[0] += rollouts;
+    worker_stats[1] += rollout_plies;
+    worker_stats[2] += adjudicated;
+    eval_cache.merge_stats();
 }
 
 // Phase 1: Selection
@@ -113,7 +873,7 @@ void select(MCTSNode *node, Board &board) {
         if (node->children.size() > 0) {
             MCTSNode *child = node->children[rng.next() % node->children.size()];
             board.make_move(child->move);
-            double score = -simulate(board);
+            double score = -rollout(board);
             board.unmake_move();
             backpropagate(child, score);
             games++;
@@ -122,20 +882,12 @@ void select(MCTSNode *node, Board &board) {
             double score = -simulate(board);
             backpropagate(node, score);
             games++;
+            if (node->proven != UNPROVEN)
+                propagate_proof(node);
         }
     } else {
         // Otherwise, select the child with the highest PUCT value
-        double best_puct = -1e9;
-        MCTSNode *best_child = nullptr;
-
-        for (auto &child : node->children) {
-            double puct = child->puctval(c_puct);
-            if (puct > best_puct) {
-                best_puct = puct;
-                best_child = child;
-            }
-        }
-
+        MCTSNode *best_child = choose_child(node);
         if (best_child) {
             select(best_child, board);
         }
@@ -147,6 +899,8 @@ void select(MCTSNode *node, Board &board) {
 // Expands the node by adding a new child
 void expand(MCTSNode *node, Board &board) {
     if (is_game_over(board)) {
+        // Repetition or fifty move rule
+        node->proven = PROVEN_DRAW;
         return; // No moves to expand
     }
 
@@ -156,38 +910,202 @@ void expand(MCTSNode *node, Board &board) {
     uint8_t end = board.ended(psuedo_moves, moves);
 
     if (end) {
-        // Stalemate or checkmate
+        // Stalemate or checkmate, the latter is a win for whoever moved into this node
+        node->proven = end == 1 ? PROVEN_WIN : PROVEN_DRAW;
+        return;
+    }
+
+    // `go searchmoves` restricts the root, unless none of the moves it lists is legal here
+    if (!node->parent && !root_moves.empty()) {
+        int kept = 0;
+        for (int i = 0; i < moves.size(); i++) {
+            if (std::find(root_moves.begin(), root_moves.end(), moves[i]) != root_moves.end())
+                moves[kept++] = moves[i];
+        }
+        while (kept && moves.size() > kept)
+            moves.pop_back();
+    }
+
+    const int initial = widen_limit(node, moves.size());
+    if (node_pool.available() < (size_t)((moves.size() + EdgeChunk::CAPACITY - 1) / EdgeChunk::CAPACITY + initial)) {
+        // Out of nodes, the caller treats this node as a leaf until garbage collection makes room
         return;
     }
 
+    int32_t child_evals[PZSTL_MAX_SIZE];
+    float logits[PZSTL_MAX_SIZE];
+    int32_t best_eval = 0;
+    float best_logit = 0;
+    bool policy = false;
+    // Without a policy head the network has nothing to say about priors unless value priors are on
+    const bool want_policy = policy_priors && nn_policy;
+    if (value_priors || want_policy) {
+        // One accumulator refresh serves both the child evaluations and the policy logits
+        policy = eval_children(board, moves, value_priors ? child_evals : nullptr, want_policy ? logits : nullptr);
+        if (value_priors)
+            best_eval = *std::max_element(child_evals, child_evals + moves.size());
+        if (policy)
+            best_logit = *std::max_element(logits, logits + moves.size());
+    }
+
     double tot_score = 0;
-    pzstd::vector<double> scores;
+    double scores[PZSTL_MAX_SIZE];
     for (int i = 0; i < moves.size(); i++) {
         Move &move = moves[i];
-        double score = score_move(move, board);
+        double score = policy ? exp((logits[i] - best_logit) / POLICY_TEMP) : score_move(move, board);
+        if (value_priors) {
+            // Relative to the best child so the exponent never overflows
+            score *= exp((child_evals[i] - best_eval) / VALUE_PRIOR_TEMP);
+        }
         tot_score += score;
-        scores.push_back(score);
+        scores[i] = score;
     }
 
+    Edge edges[PZSTL_MAX_SIZE];
     for (int i = 0; i < moves.size(); i++) {
-        Move &move = moves[i];
-        MCTSNode *child = new MCTSNode();
-        child->move = move;
-        child->parent = node;
         // Ensure we don't divide by zero
-        child->prior = tot_score > 0 ? scores[i] / tot_score : 1.0 / moves.size();
-        node->children.push_back(child);
+        edges[i] = {moves[i], (float)(tot_score > 0 ? scores[i] / tot_score : 1.0 / moves.size())};
+    }
+    // Widening hands out nodes in edge order, so the most promising moves come first
+    std::stable_sort(edges, edges + moves.size(), [](const Edge &a, const Edge &b) { return a.prior > b.prior; });
+    node_pool.store_edges(node, edges, moves.size());
+    for (int i = 0; i < initial; i++)
+        node_pool.widen(node);
+}
+
+// Rollout move under the current policy: uniform, or greedy on the learned tables with ROLLOUT_EPSILON exploration
+static Move rollout_move(Board &board, pzstd::vector<Move> &moves) {
+    const int size = moves.size();
+    if (rollout_policy == ROLLOUT_UNIFORM || rng.next_double() < ROLLOUT_EPSILON)
+        return moves[rng.next() % size];
+    const Move prev = board.move_hist.empty() ? NullMove : board.move_hist.top().move();
+    // Scanning from a random offset breaks ties between moves the tables know nothing about
+    const int offset = rng.next() % size;
+    Move best = NullMove;
+    float best_value = -1e9;
+    for (int i = 0; i < size; i++) {
+        Move move = moves[(offset + i) % size];
+        float value = rollout_policy == ROLLOUT_NST ? rollout_tables.nst_value(board.side, prev, move) : rollout_tables.mast_value(board.side, move);
+        if (value > best_value) {
+            best_value = value;
+            best = move;
+        }
+    }
+    return best;
+}
+
+// Picks the legal capture with the best static exchange, or NullMove if every capture loses material
+static Move best_capture(Board &board, pzstd::vector<Move> &moves) {
+    const Bitboard them = board.piece_boards[OCC(!board.side)];
+    Move best = NullMove;
+    Value best_see = 0;
+    for (Move &move : moves) {
+        if (!(them & square_bits(move.dst())) && move.type() != EN_PASSANT)
+            continue;
+        Value see = board.see_capture(move);
+        if (see >= best_see) {
+            best_see = see;
+            best = move;
+        }
+    }
+    return best;
+}
+
+// Decides a rollout without playing it out, score is set from the side to move's perspective
+// The eval margin is only checked when check_eval is set since it costs a network evaluation
+static bool adjudicate(Board &board, bool check_eval, double &score) {
+    if (!adjudication)
+        return false;
+    if (board.insufficient_material()) {
+        score = 0.0;
+        return true;
+    }
+    const Value lead = board.material[board.side] - board.material[!board.side];
+    if (std::abs(lead) >= ADJUDICATE_MATERIAL) {
+        score = lead > 0 ? 1.0 : -1.0;
+        return true;
+    }
+    if (check_eval) {
+        double eval_score = eval(board);
+        eval_score = board.side == WHITE ? eval_score : -eval_score;
+        if (std::abs(eval_score) >= ADJUDICATE_EVAL) {
+            score = eval_score > 0 ? 1.0 : -1.0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Plays ROLLOUT_PLIES random plies, then SEE-ordered captures until the position is quiet, and returns eval()
+// Same score convention as simulate()
+static double hybrid_rollout(Board &board) {
+    double score = 0;
+    int plies = 0;
+    while (true) {
+        if (board.threefold() || board.halfmove >= 100) {
+            score = 0.0; // Draw
+            break;
+        }
+        if (adjudicate(board, false, score)) {
+            adjudicated++;
+            break;
+        }
+
+        pzstd::vector<Move> psuedo_moves, moves;
+        board.legal_moves(psuedo_moves);
+        uint8_t end = board.ended(psuedo_moves, moves);
+        if (end) {
+            score = end == 1 ? -1.0 : 0.0; // Checkmate or stalemate
+            break;
+        }
+
+        Move move = NullMove;
+        if (plies < ROLLOUT_PLIES)
+            move = rollout_move(board, moves);
+        else if (plies < ROLLOUT_PLIES + RESOLVE_PLIES)
+            move = best_capture(board, moves);
+        if (move == NullMove) {
+            double eval_score = eval(board);
+            score = board.side == WHITE ? eval_score : -eval_score;
+            break;
+        }
+        board.make_move(move);
+        if (plies < MAX_ROLLOUT_MOVES)
+            rollout_moves[rollout_len++] = move;
+        plies++;
+        // Any position of the capture resolution may turn out quiet and be evaluated, start pulling its bucket in
+        if (plies >= ROLLOUT_PLIES)
+            eval_cache.prefetch(board.zobrist);
     }
+
+    rollout_plies += plies;
+    for (int i = 0; i < plies; i++)
+        board.unmake_move();
+    // The score is from the side to move at the end of the rollout
+    return plies & 1 ? -score : score;
 }
 
 // Phase 3: Simulation
 // Simulates a random game from the current node
 // Returns the score of the game, where 1 is a win for the side to move and -1 is a loss
 double simulate(Board &board, int depth) {
+    if (depth == 0) {
+        rollouts++;
+        rollout_len = 0;
+        if (rollout_mode == ROLLOUT_HYBRID)
+            return hybrid_rollout(board);
+    }
+
     if (board.threefold() || board.halfmove >= 100) {
         return 0.0; // Draw
     }
 
+    double score;
+    if (adjudicate(board, depth > 0 && depth % ADJUDICATE_EVAL_INTERVAL == 0, score)) {
+        adjudicated++;
+        return score;
+    }
+
     if (depth >= 60 && rng.next() % 10 == 0) {
         // Use evaluation function, normalize to [-1, 1] range
         double eval_score = eval(board);
@@ -214,16 +1132,76 @@ double simulate(Board &board, int depth) {
         return 0.0;
     }
 
-    Move &move = moves[rng.next() % moves.size()];
+    Move move = rollout_move(board, moves);
     board.make_move(move);
-    double score = -simulate(board, depth + 1); // Negate for opponent's perspective
+    if (depth < MAX_ROLLOUT_MOVES)
+        rollout_moves[rollout_len++] = move;
+    rollout_plies++;
+    // Same conditions as the evaluations above, one ply further
+    if (((depth + 1) % ADJUDICATE_EVAL_INTERVAL == 0 && adjudication) || depth + 1 >= 60)
+        eval_cache.prefetch(board.zobrist);
+    score = -simulate(board, depth + 1); // Negate for opponent's perspective
     board.unmake_move();
     return score;
 }
 
+// Fills simulation_moves from the path to leaf and the last rollout, and returns the depth of leaf
+// Returns -1 when the simulation does not fit
+static int gather_simulation(MCTSNode *leaf, int &len) {
+    int depth = 0;
+    for (MCTSNode *node = leaf; node->parent; node = node->parent)
+        depth++;
+    if (depth + rollout_len > MAX_SIMULATION_MOVES)
+        return -1;
+    len = depth;
+    for (MCTSNode *node = leaf; node->parent; node = node->parent)
+        simulation_moves[--len] = node->move;
+    std::copy(rollout_moves, rollout_moves + rollout_len, simulation_moves + depth);
+    len = depth + rollout_len;
+    return depth;
+}
+
+// Teaches the rollout tables every move of the simulation, score is from the perspective of the player who made leaf->move
+static void update_rollout_tables(double score, int depth, int len) {
+    for (int i = 0; i < len; i++) {
+        const bool side = root_side ^ (i & 1);
+        const Move prev = i ? simulation_moves[i - 1] : root_prev;
+        rollout_tables.update(side, prev, simulation_moves[i], (depth - 1 - i) & 1 ? -score : score);
+    }
+}
+
+// Credits every sibling along the path whose move the same side went on to play later in the simulation
+// score is from the perspective of the player who made leaf->move
+static void update_amaf(MCTSNode *leaf, double score, int depth, int len) {
+    const Move *seq = simulation_moves;
+    int i = depth - 1;
+    for (MCTSNode *node = leaf; node->parent; node = node->parent, i--, score = -score) {
+        if (++amaf_stamp == 0) {
+            std::fill(amaf_seen, amaf_seen + (1 << 16), 0);
+            amaf_stamp = 1;
+        }
+        // Moves by the side to move at the parent, starting with the one actually played there
+        for (int j = i; j < len; j += 2)
+            amaf_seen[seq[j].data] = amaf_stamp;
+        for (MCTSNode *sibling : node->parent->children) {
+            if (amaf_seen[sibling->move.data] == amaf_stamp) {
+                sibling->amaf_val += score;
+                sibling->amaf_nsims++;
+            }
+        }
+    }
+}
+
 // Phase 4: Backpropagation
 // This is done in the other functions, as we update the node's win count and simulation count
 void backpropagate(MCTSNode *node, double score) {
+    if (rave || rollout_policy != ROLLOUT_UNIFORM) {
+        int len, depth = gather_simulation(node, len);
+        if (depth >= 0 && rave)
+            update_amaf(node, score, depth, len);
+        if (depth >= 0 && rollout_policy != ROLLOUT_UNIFORM && !tables_frozen)
+            update_rollout_tables(score, depth, len);
+    }
     while (node != nullptr) {
         node->val += score;
         node->nsims++;
@@ -234,4 +1212,60 @@ void backpropagate(MCTSNode *node, double score) {
 
 void set_puct_constant(double c) {
     c_puct = c;
+}
+
+void set_value_priors(bool enabled) {
+    value_priors = enabled;
+}
+
+void set_policy_priors(bool enabled) {
+    policy_priors = enabled;
+}
+
+void set_rollout_mode(RolloutMode mode) {
+    rollout_mode = mode;
+}
+
+void set_rollout_policy(RolloutPolicy policy) {
+    rollout_policy = policy;
+}
+
+void set_gumbel(bool enabled) {
+    gumbel = enabled;
+}
+
+void set_rave(bool enabled) {
+    rave = enabled;
+}
+
+void set_widening(bool enabled) {
+    widening = enabled;
+}
+
+void set_threads(int n) {
+    threads = std::max(1, n);
+}
+
+void set_pipeline_depth(int n) {
+    pipeline_depth = std::max(1, n);
+}
+
+void set_hash_size(int mb) {
+    node_pool.resize(mb);
+}
+
+void set_adjudication(bool enabled) {
+    adjudication = enabled;
+}
+
+void set_info_interval(int ms) {
+    info_reporter.interval = std::max(1, ms);
+}
+
+void set_multipv(int n) {
+    multipv = std::max(1, n);
+}
+
+void set_deterministic(bool enabled) {
+    deterministic = enabled;
 }
\ No newline at end of file
@@ -2,15 +2,24 @@
 
 #include "includes.hpp"
 
+#include "batchrollout.hpp"
 #include "bitboard.hpp"
 #include "move.hpp"
 #include "movegen.hpp"
 #include "node.hpp"
 #include "eval.hpp"
+#include "movetimings.hpp"
 #include "random.hpp"
+#include "reporter.hpp"
+#include "rollouttables.hpp"
 #include "util.hpp"
 
+enum RolloutMode { ROLLOUT_RANDOM, ROLLOUT_HYBRID, ROLLOUT_BATCH };
+enum RolloutPolicy { ROLLOUT_UNIFORM, ROLLOUT_MAST, ROLLOUT_NST };
+
 int ngames();
+// Hash of the root visit distribution of the last search, equal across runs of a deterministic search
+uint64_t search_signature();
 
 void select(MCTSNode *node, Board &board);
 void expand(MCTSNode *node, Board &board);
@@ -18,6 +27,28 @@ double simulate(Board &board, int depth=0);
 void backpropagate(MCTSNode *node, double score);
 
 void set_puct_constant(double c);
+void set_value_priors(bool enabled);
+void set_policy_priors(bool enabled);
+void set_rollout_mode(RolloutMode mode);
+void set_rollout_policy(RolloutPolicy policy);
+void set_adjudication(bool enabled);
+void set_hash_size(int mb);
+// Threads past the first become rollout workers fed by the tree thread through a pipeline of pipeline_depth leaves
+void set_threads(int n);
+void set_pipeline_depth(int n);
+void set_gumbel(bool enabled);
+void set_rave(bool enabled);
+void set_widening(bool enabled);
+// Root moves reported by every info update
+void set_multipv(int n);
+// Milliseconds between info updates, printed by a reporter thread so the search never waits on output
+void set_info_interval(int ms);
+// Seeded, node limited searches whose pipeline backs results up in a fixed order, for any number of threads
+void set_deterministic(bool enabled);
 
-std::pair<Move, Value> search(Board &board, int time=1e9, int side=1);
+std::pair<Move, Value> search(Board &board, const SearchLimits &limits, bool online = false);
+// Makes a running search return as soon as possible, safe to call from another thread
+void stop_search();
+// Drops a stop request that arrived after the search it was meant for had already returned
+void clear_stop();
 
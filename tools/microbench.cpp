@@ -0,0 +1,237 @@
+// Microbenchmarks of the engine primitives over the bench positions
+// Every primitive is warmed up, then timed in REPEATS samples of at least SAMPLE_NS each, reporting ns per call
+// Usage: montecraplo-microbench [filter], only primitives whose name contains filter are run
+
+#include "../engine/bench.hpp"
+#include "../engine/search.hpp"
+
+#include <chrono>
+#include <vector>
+
+constexpr int REPEATS = 15;
+constexpr int WARMUP = 3;
+constexpr double SAMPLE_NS = 20e6;
+
+// Keeps the optimizer from discarding the results of the timed code
+static volatile uint64_t sink;
+
+static std::string filter;
+
+// Times pass, which performs ops operations and returns a value to sink, and prints median, min, max and spread per op
+template <typename F>
+static void measure(const char *name, int64_t ops, F &&pass) {
+	if (!strstr(name, filter.c_str()) || !ops)
+		return;
+	typedef std::chrono::steady_clock clock;
+	for (int i = 0; i < WARMUP; i++)
+		sink = sink + pass();
+
+	// Enough passes per sample that timer resolution and loop overhead do not matter
+	const clock::time_point start = clock::now();
+	sink = sink + pass();
+	const double pass_ns = std::max<double>(std::chrono::duration<double, std::nano>(clock::now() - start).count(), 1);
+	const int64_t passes = std::max<int64_t>(1, SAMPLE_NS / pass_ns);
+
+	std::vector<double> samples;
+	for (int r = 0; r < REPEATS; r++) {
+		const clock::time_point t0 = clock::now();
+		for (int64_t p = 0; p < passes; p++)
+			sink = sink + pass();
+		samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - t0).count() / (passes * ops));
+	}
+	std::sort(samples.begin(), samples.end());
+	double mean = 0, var = 0;
+	for (double s : samples)
+		mean += s / REPEATS;
+	for (double s : samples)
+		var += (s - mean) * (s - mean) / (REPEATS - 1);
+	std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1);
+	std::cout << " median " << std::setw(10) << samples[REPEATS / 2] << " ns/op  min " << std::setw(10) << samples[0];
+	std::cout << "  max " << std::setw(10) << samples[REPEATS - 1] << "  sd " << std::setw(5) << 100 * std::sqrt(var) / mean << "%";
+	std::cout << "  ops " << ops * passes << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc >= 2)
+		filter = argv[1];
+	// eval() would mostly measure cache hits otherwise
+	eval_cache.resize(0);
+
+	std::vector<Board> boards;
+	std::vector<pzstd::vector<Move>> pseudo(NBENCH_FENS), legal(NBENCH_FENS);
+	int64_t nmoves = 0, ncaptures = 0, ntargets = 0;
+	for (int i = 0; i < NBENCH_FENS; i++) {
+		boards.emplace_back(BENCH_FENS[i]);
+		boards[i].legal_moves(pseudo[i]);
+		boards[i].ended(pseudo[i], legal[i]);
+		nmoves += legal[i].size();
+		for (Move move : legal[i])
+			ncaptures += (boards[i].piece_boards[OCC(!boards[i].side)] & square_bits(move.dst())) != 0;
+		ntargets += _mm_popcnt_u64(boards[i].piece_boards[OCC(!boards[i].side)]);
+	}
+	const int64_t nboards = boards.size();
+	std::cout << "corpus " << nboards << " positions " << nmoves << " legal moves " << ncaptures << " captures" << std::endl;
+
+	measure("make_unmake", nmoves, [&] {
+		uint64_t h = 0;
+		for (int i = 0; i < nboards; i++) {
+			for (Move move : legal[i]) {
+				boards[i].make_move(move);
+				h += boards[i].zobrist;
+				boards[i].unmake_move();
+			}
+		}
+		return h;
+	});
+
+	measure("legal_moves", nboards, [&] {
+		uint64_t n = 0;
+		for (Board &board : boards) {
+			pzstd::vector<Move> moves;
+			board.legal_moves(moves);
+			n += moves.size();
+		}
+		return n;
+	});
+
+	measure("ended", nboards, [&] {
+		uint64_t n = 0;
+		for (int i = 0; i < nboards; i++) {
+			pzstd::vector<Move> moves;
+			n += boards[i].ended(pseudo[i], moves) + moves.size();
+		}
+		return n;
+	});
+
+	measure("control", nboards * 64, [&] {
+		uint64_t n = 0;
+		for (Board &board : boards) {
+			for (int sq = 0; sq < 64; sq++) {
+				std::pair<int, int> c = board.control(sq);
+				n += c.first - c.second;
+			}
+		}
+		return n;
+	});
+
+	// Exchanges on every square holding a piece of the side not to move
+	measure("see", ntargets, [&] {
+		uint64_t n = 0;
+		for (Board &board : boards) {
+			for (Bitboard targets = board.piece_boards[OCC(!board.side)]; targets; targets = _blsr_u64(targets))
+				n += board.see(Square(_tzcnt_u64(targets)));
+		}
+		return n;
+	});
+
+	measure("see_capture", ncaptures, [&] {
+		uint64_t n = 0;
+		for (int i = 0; i < nboards; i++) {
+			for (Move move : legal[i]) {
+				if (boards[i].piece_boards[OCC(!boards[i].side)] & square_bits(move.dst()))
+					n += boards[i].see_capture(move);
+			}
+		}
+		return n;
+	});
+
+	measure("eval", nboards, [&] {
+		double total = 0;
+		for (Board &board : boards)
+			total += eval(board);
+		return (uint64_t)(total * 10000);
+	});
+
+	// Only the network pieces, on accumulators built once up front, for the int16 network and its int8 quantization
+	// raw[precision][i] keeps the scores of each, so the error int8 costs can be reported next to its speed
+	std::vector<int32_t> raw[2];
+	for (bool int8 : {false, true}) {
+		use_int8_network(int8);
+		const std::string suffix = int8 ? "_i8" : "";
+		raw[int8].resize(nboards);
+		with_network([&](const auto &net) {
+			typedef std::remove_reference_t<decltype(net)> Net;
+			std::vector<typename Net::Accumulator> w_accs(nboards), b_accs(nboards);
+			std::vector<uint8_t> buckets(nboards);
+			for (int i = 0; i < nboards; i++) {
+				uint16_t w_idx[32], b_idx[32];
+				int n = 0;
+				for (Bitboard pieces = boards[i].piece_boards[OCC(WHITE)] | boards[i].piece_boards[OCC(BLACK)]; pieces; pieces = _blsr_u64(pieces)) {
+					const Square sq = Square(_tzcnt_u64(pieces));
+					const PieceType pt = PieceType(boards[i].mailbox[sq] & 7);
+					const bool side = boards[i].piece_boards[OCC(BLACK)] & square_bits(sq);
+					w_idx[n] = calculate_index(sq, pt, side, WHITE);
+					b_idx[n++] = calculate_index(sq, pt, side, BLACK);
+				}
+				accumulator_refresh(net, w_accs[i], b_accs[i], w_idx, b_idx, n);
+				buckets[i] = output_bucket<Net>(n);
+				const bool white = boards[i].side == WHITE;
+				raw[int8][i] = nn_eval(net, white ? w_accs[i] : b_accs[i], white ? b_accs[i] : w_accs[i], buckets[i]);
+			}
+
+			measure(("nn_eval" + suffix).c_str(), nboards, [&] {
+				uint64_t total = 0;
+				for (int i = 0; i < nboards; i++) {
+					const bool white = boards[i].side == WHITE;
+					total += nn_eval(net, white ? w_accs[i] : b_accs[i], white ? b_accs[i] : w_accs[i], buckets[i]);
+				}
+				return total;
+			});
+
+			// The int8 network shares the feature transformer, only its output layer is worth timing
+			if (int8)
+				return;
+			// Adds alternate with subtractions of the same feature so the accumulator keeps its values, both cost the same
+			measure("accumulator_add", 768, [&] {
+				typename Net::Accumulator &acc = w_accs[0];
+				for (uint16_t index = 0; index < 768; index += 2) {
+					accumulator_add(net, acc, index);
+					accumulator_sub(net, acc, index);
+				}
+				return (uint64_t)acc.val[0];
+			});
+		});
+	}
+	use_int8_network(false);
+	if (strstr("nn_eval_i8", filter.c_str())) {
+		int64_t error_sum = 0, error_max = 0;
+		for (int i = 0; i < nboards; i++) {
+			const int64_t error = std::abs(raw[1][i] - raw[0][i]);
+			error_sum += error;
+			error_max = std::max(error_max, error);
+		}
+		std::cout << "int8 error           mean " << std::fixed << std::setprecision(1) << (double)error_sum / nboards << std::defaultfloat << " cp  max " << error_max << " cp  (" << network_description();
+		use_int8_network(true);
+		std::cout << " vs " << network_description() << ")" << std::endl;
+		use_int8_network(false);
+	}
+
+	// Whole simulations: descent, expansion of the leaf and its rollout, 64 per position on a tree rebuilt every pass
+	measure("select", nboards * 64, [&] {
+		for (Board &board : boards) {
+			MCTSNode *root = node_pool.alloc();
+			for (int i = 0; i < 64; i++)
+				select(root, board);
+			node_pool.release(root);
+		}
+		return (uint64_t)ngames();
+	});
+
+	measure("expand", nboards, [&] {
+		uint64_t n = 0;
+		for (Board &board : boards) {
+			MCTSNode *node = node_pool.alloc();
+			expand(node, board);
+			n += node->children.total;
+			node_pool.release(node);
+		}
+		return n;
+	});
+
+	measure("simulate", nboards, [&] {
+		double total = 0;
+		for (Board &board : boards)
+			total += simulate(board);
+		return (uint64_t)(total * 10000);
+	});
+}
@@ -0,0 +1,401 @@
+// CPU trainer for the value network
+// Trains DefaultNetwork in float on packed positions and writes it in the engine's network file format
+// Usage: montecraplo-train <data> <output> [--epochs N] [--batch N] [--lr X] [--wdl X] [--threads N] [--init <embedded|checkpoint>]
+
+#include "../engine/nn/network.hpp"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef DefaultNetwork QNet;
+constexpr int HL = QNet::HL_SIZE;
+constexpr int NB = QNet::NBUCKETS;
+
+// Every weight is kept within this range so that clamp(x) * w still fits in 16 bits after quantization
+constexpr float WEIGHT_CLIP = 1.98f;
+
+// bulletformat ChessBoard: the position is flipped so that the side to move is white, pieces are stored as
+// nibbles (bit 3 set for the opponent, low bits the piece type) in the order of the set bits of occ,
+// and score (centipawns) and result (0 loss, 1 draw, 2 win) are both from the side to move's point of view
+struct PackedBoard {
+	uint64_t occ;
+	uint8_t pcs[16];
+	int16_t score;
+	uint8_t result;
+	uint8_t ksq;
+	uint8_t opp_ksq;
+	uint8_t extra[3];
+};
+static_assert(sizeof(PackedBoard) == 32, "packed boards are 32 bytes on disk");
+
+struct Params {
+	alignas(32) float ft[INPUT_SIZE][HL];
+	float ft_bias[HL];
+	float out[NB][2 * HL];
+	float out_bias[NB];
+
+	static constexpr size_t SIZE = INPUT_SIZE * HL + HL + NB * 2 * HL + NB;
+	float *data() { return &ft[0][0]; }
+};
+static_assert(sizeof(Params) == Params::SIZE * sizeof(float), "Params is treated as a flat array");
+
+struct Sample {
+	uint16_t stm[32], ntm[32];
+	uint8_t n, bucket;
+	float target;
+};
+
+struct Options {
+	std::string data, output, init;
+	int epochs = 40;
+	int batch = 16384;
+	float lr = 0.001f;
+	float wdl = 0.25f; // Weight of the game result in the target, the rest comes from the score
+	int threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+static inline float sigmoid(float x) {
+	return 1.0f / (1.0f + std::exp(-x));
+}
+
+static bool decode(const PackedBoard &board, float wdl, Sample &s) {
+	uint64_t occ = board.occ;
+	int n = 0;
+	while (occ) {
+		if (n == 32)
+			return false;
+		const Square sq = (Square)_tzcnt_u64(occ);
+		occ = _blsr_u64(occ);
+		const uint8_t pc = (board.pcs[n / 2] >> (4 * (n & 1))) & 15;
+		if ((pc & 7) > KING)
+			return false;
+		// White is always to move in the packed board, so the white perspective is the side to move's
+		s.stm[n] = calculate_index(sq, PieceType(pc & 7), pc >> 3, WHITE);
+		s.ntm[n] = calculate_index(sq, PieceType(pc & 7), pc >> 3, BLACK);
+		n++;
+	}
+	s.n = n;
+	s.bucket = output_bucket<QNet>(n);
+	s.target = wdl * board.result / 2.0f + (1 - wdl) * sigmoid((float)board.score / QNet::SCALE);
+	return board.result <= 2;
+}
+
+// dst += src over one hidden layer row
+static inline void add_row(float *dst, const float *src) {
+#ifdef __AVX2__
+	for (int i = 0; i < HL; i += 8)
+		_mm256_store_ps(dst + i, _mm256_add_ps(_mm256_load_ps(dst + i), _mm256_load_ps(src + i)));
+#else
+	for (int i = 0; i < HL; i++)
+		dst[i] += src[i];
+#endif
+}
+
+// Sum of screlu(acc) * w
+static inline float screlu_dot(const float *acc, const float *w) {
+#ifdef __AVX2__
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	__m256 sum = zero;
+	for (int i = 0; i < HL; i += 8) {
+		__m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(acc + i), zero), one);
+		sum = _mm256_fmadd_ps(_mm256_mul_ps(x, x), _mm256_loadu_ps(w + i), sum);
+	}
+	__m128 r = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	r = _mm_add_ps(r, _mm_movehl_ps(r, r));
+	r = _mm_add_ss(r, _mm_movehdup_ps(r));
+	return _mm_cvtss_f32(r);
+#else
+	float sum = 0;
+	for (int i = 0; i < HL; i++) {
+		float x = std::clamp(acc[i], 0.0f, 1.0f);
+		sum += x * x * w[i];
+	}
+	return sum;
+#endif
+}
+
+// Output layer gradient (g_w += grad * screlu(acc)) and the gradient flowing back into the accumulator
+static inline void screlu_backward(const float *acc, const float *w, float grad, float *g_w, float *g_acc) {
+#ifdef __AVX2__
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	const __m256 g = _mm256_set1_ps(grad), g2 = _mm256_set1_ps(2 * grad);
+	for (int i = 0; i < HL; i += 8) {
+		__m256 a = _mm256_load_ps(acc + i);
+		__m256 x = _mm256_min_ps(_mm256_max_ps(a, zero), one);
+		_mm256_storeu_ps(g_w + i, _mm256_fmadd_ps(g, _mm256_mul_ps(x, x), _mm256_loadu_ps(g_w + i)));
+		// The derivative is 2x inside (0, 1) and zero where the clamp is active
+		__m256 live = _mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_GT_OQ), _mm256_cmp_ps(a, one, _CMP_LT_OQ));
+		_mm256_store_ps(g_acc + i, _mm256_and_ps(live, _mm256_mul_ps(_mm256_mul_ps(g2, a), _mm256_loadu_ps(w + i))));
+	}
+#else
+	for (int i = 0; i < HL; i++) {
+		float x = std::clamp(acc[i], 0.0f, 1.0f);
+		g_w[i] += grad * x * x;
+		g_acc[i] = acc[i] > 0 && acc[i] < 1 ? 2 * grad * acc[i] * w[i] : 0;
+	}
+#endif
+}
+
+// Forward and backward pass of one position, accumulating into grad and returning the loss
+static float train_sample(const Params &p, Params &grad, const Sample &s) {
+	alignas(32) float stm[HL], ntm[HL], g_stm[HL], g_ntm[HL];
+	memcpy(stm, p.ft_bias, sizeof(stm));
+	memcpy(ntm, p.ft_bias, sizeof(ntm));
+	for (int i = 0; i < s.n; i++) {
+		add_row(stm, p.ft[s.stm[i]]);
+		add_row(ntm, p.ft[s.ntm[i]]);
+	}
+
+	const float *w = p.out[s.bucket];
+	const float out = p.out_bias[s.bucket] + screlu_dot(stm, w) + screlu_dot(ntm, w + HL);
+	const float pred = sigmoid(out);
+	const float err = pred - s.target;
+
+	// d/dout of (sigmoid(out) - target)^2
+	const float g = 2 * err * pred * (1 - pred);
+	grad.out_bias[s.bucket] += g;
+	screlu_backward(stm, w, g, grad.out[s.bucket], g_stm);
+	screlu_backward(ntm, w + HL, g, grad.out[s.bucket] + HL, g_ntm);
+
+	// Only the rows of active features receive a gradient
+	add_row(grad.ft_bias, g_stm);
+	add_row(grad.ft_bias, g_ntm);
+	for (int i = 0; i < s.n; i++) {
+		add_row(grad.ft[s.stm[i]], g_stm);
+		add_row(grad.ft[s.ntm[i]], g_ntm);
+	}
+	return err * err;
+}
+
+struct Adam {
+	static constexpr float BETA1 = 0.9f, BETA2 = 0.999f, EPS = 1e-8f;
+	std::unique_ptr<float[]> m, v;
+	int t = 0;
+
+	Adam() : m(new float[Params::SIZE]()), v(new float[Params::SIZE]()) {}
+
+	void step(Params &p, const Params &grad, float lr) {
+		t++;
+		const float c1 = 1 - std::pow(BETA1, t), c2 = 1 - std::pow(BETA2, t);
+		float *w = p.data();
+		const float *g = const_cast<Params &>(grad).data();
+		for (size_t i = 0; i < Params::SIZE; i++) {
+			m[i] = BETA1 * m[i] + (1 - BETA1) * g[i];
+			v[i] = BETA2 * v[i] + (1 - BETA2) * g[i] * g[i];
+			w[i] -= lr * (m[i] / c1) / (std::sqrt(v[i] / c2) + EPS);
+			w[i] = std::clamp(w[i], -WEIGHT_CLIP, WEIGHT_CLIP);
+		}
+	}
+};
+
+static void init_params(Params &p, const std::string &init) {
+	if (init == "embedded") {
+		// Fine-tune the network the engine ships with
+		load_embedded_network();
+		const QNet &net = *(const QNet *)nn_network;
+		for (int f = 0; f < INPUT_SIZE; f++)
+			for (int i = 0; i < HL; i++)
+				p.ft[f][i] = (float)net.accumulator_weights[f][i] / QNet::QA;
+		for (int i = 0; i < HL; i++)
+			p.ft_bias[i] = (float)net.accumulator_biases[i] / QNet::QA;
+		for (int b = 0; b < NB; b++) {
+			for (int i = 0; i < 2 * HL; i++)
+				p.out[b][i] = (float)net.output_weights[b][i] / QNet::QB;
+			p.out_bias[b] = (float)net.output_bias[b] / (QNet::QA * QNet::QB);
+		}
+	} else if (!init.empty()) {
+		std::ifstream in(init, std::ios::binary);
+		if (!in.read((char *)p.data(), sizeof(Params))) {
+			std::cerr << "failed to read checkpoint " << init << std::endl;
+			exit(1);
+		}
+	} else {
+		std::mt19937 gen(1);
+		std::normal_distribution<float> ft_dist(0, 1 / std::sqrt(32.0f)), out_dist(0, 1 / std::sqrt(2.0f * HL));
+		for (int f = 0; f < INPUT_SIZE; f++)
+			for (int i = 0; i < HL; i++)
+				p.ft[f][i] = ft_dist(gen);
+		for (int i = 0; i < HL; i++)
+			p.ft_bias[i] = 0;
+		for (int b = 0; b < NB; b++) {
+			for (int i = 0; i < 2 * HL; i++)
+				p.out[b][i] = out_dist(gen);
+			p.out_bias[b] = 0;
+		}
+	}
+}
+
+static inline int16_t quantize(float x, float scale) {
+	return (int16_t)std::clamp(std::lround(x * scale), -32768L, 32767L);
+}
+
+// Writes the quantized network with a header, so the engine can load it through EvalFile
+static bool write_network(const Params &p, const std::string &path) {
+	std::unique_ptr<QNet> net(new QNet());
+	for (int f = 0; f < INPUT_SIZE; f++)
+		for (int i = 0; i < HL; i++)
+			net->accumulator_weights[f][i] = quantize(p.ft[f][i], QNet::QA);
+	for (int i = 0; i < HL; i++)
+		net->accumulator_biases[i] = quantize(p.ft_bias[i], QNet::QA);
+	for (int b = 0; b < NB; b++) {
+		for (int i = 0; i < 2 * HL; i++)
+			net->output_weights[b][i] = quantize(p.out[b][i], QNet::QB);
+		net->output_bias[b] = quantize(p.out_bias[b], QNet::QA * QNet::QB);
+	}
+
+	NetworkHeader header = {};
+	memcpy(header.magic, NETWORK_MAGIC, sizeof(header.magic));
+	header.version = NETWORK_VERSION;
+	header.input_size = INPUT_SIZE;
+	header.hl_size = HL;
+	header.nbuckets = NB;
+	header.qa = QNet::QA;
+	header.qb = QNet::QB;
+	header.scale = QNet::SCALE;
+	header.payload_size = QNet::BYTES;
+	header.checksum = network_checksum(net.get(), QNet::BYTES);
+
+	std::ofstream out(path, std::ios::binary);
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)net.get(), QNet::BYTES);
+	return (bool)out;
+}
+
+static void parse_options(int argc, char **argv, Options &opts) {
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0] << " <data> <output> [--epochs N] [--batch N] [--lr X] [--wdl X] [--threads N] [--init <embedded|checkpoint>]" << std::endl;
+		exit(1);
+	}
+	opts.data = argv[1];
+	opts.output = argv[2];
+	for (int i = 3; i + 1 < argc; i += 2) {
+		std::string flag = argv[i], value = argv[i + 1];
+		if (flag == "--epochs")
+			opts.epochs = std::stoi(value);
+		else if (flag == "--batch")
+			opts.batch = std::stoi(value);
+		else if (flag == "--lr")
+			opts.lr = std::stof(value);
+		else if (flag == "--wdl")
+			opts.wdl = std::stof(value);
+		else if (flag == "--threads")
+			opts.threads = std::max(1, std::stoi(value));
+		else if (flag == "--init")
+			opts.init = value;
+		else
+			std::cerr << "ignoring unknown option " << flag << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	Options opts;
+	parse_options(argc, argv, opts);
+
+	int fd = open(opts.data.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PackedBoard)) {
+		std::cerr << "cannot open " << opts.data << std::endl;
+		return 1;
+	}
+	const size_t npositions = st.st_size / sizeof(PackedBoard);
+	const PackedBoard *positions = (const PackedBoard *)mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (positions == MAP_FAILED) {
+		std::cerr << "cannot map " << opts.data << std::endl;
+		return 1;
+	}
+	// Batches are visited in a random order every epoch, positions within a batch in file order
+	madvise((void *)positions, st.st_size, MADV_RANDOM);
+
+	std::unique_ptr<Params> params(new Params());
+	init_params(*params, opts.init);
+	Adam adam;
+
+	const int nthreads = opts.threads;
+	std::vector<std::unique_ptr<Params>> grads;
+	for (int t = 0; t < nthreads; t++)
+		grads.emplace_back(new Params());
+	std::vector<double> losses(nthreads);
+	std::vector<size_t> skipped(nthreads);
+
+	const size_t nbatches = (npositions + opts.batch - 1) / opts.batch;
+	std::vector<size_t> order(nbatches);
+	for (size_t i = 0; i < nbatches; i++)
+		order[i] = i;
+	std::mt19937_64 gen(1);
+
+	std::cout << "training " << INPUT_SIZE << "->" << HL << "x2->" << NB << " on " << npositions << " positions, " << nthreads << " threads" << std::endl;
+	for (int epoch = 1; epoch <= opts.epochs; epoch++) {
+		// Cosine decay down to 1% of the initial learning rate
+		const float lr = opts.lr * (0.01f + 0.99f * 0.5f * (1 + std::cos(M_PI * (epoch - 1) / opts.epochs)));
+		std::shuffle(order.begin(), order.end(), gen);
+		const auto start = std::chrono::steady_clock::now();
+		double epoch_loss = 0;
+		size_t epoch_count = 0;
+
+		for (size_t batch : order) {
+			const size_t begin = batch * opts.batch, end = std::min(npositions, begin + opts.batch);
+			// Each thread gets a contiguous slice of the batch and its own gradient
+			auto worker = [&](int t) {
+				Params &grad = *grads[t];
+				memset(grad.data(), 0, sizeof(Params));
+				double loss = 0;
+				size_t bad = 0;
+				Sample s;
+				const size_t per = (end - begin + nthreads - 1) / nthreads;
+				for (size_t i = begin + t * per; i < std::min(end, begin + (t + 1) * per); i++) {
+					if (decode(positions[i], opts.wdl, s))
+						loss += train_sample(*params, grad, s);
+					else
+						bad++;
+				}
+				losses[t] = loss;
+				skipped[t] = bad;
+			};
+			std::vector<std::thread> workers;
+			for (int t = 1; t < nthreads; t++)
+				workers.emplace_back(worker, t);
+			worker(0);
+			for (auto &w : workers)
+				w.join();
+
+			size_t used = end - begin;
+			for (int t = 0; t < nthreads; t++) {
+				epoch_loss += losses[t];
+				used -= skipped[t];
+			}
+			epoch_count += used;
+			// Reduce into the first gradient, normalized by the batch size
+			float *g = grads[0]->data();
+			for (int t = 1; t < nthreads; t++) {
+				const float *other = grads[t]->data();
+				for (size_t i = 0; i < Params::SIZE; i++)
+					g[i] += other[i];
+			}
+			const float inv = used ? 1.0f / used : 0;
+			for (size_t i = 0; i < Params::SIZE; i++)
+				g[i] *= inv;
+			adam.step(*params, *grads[0], lr);
+		}
+
+		const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "epoch " << epoch << " loss " << std::setprecision(6) << epoch_loss / std::max<size_t>(epoch_count, 1) << " lr " << lr
+				  << " pos/s " << (size_t)(epoch_count / secs) << std::endl;
+
+		// Keep a float checkpoint around so training can be resumed with --init
+		std::ofstream ckpt(opts.output + ".ckpt", std::ios::binary);
+		ckpt.write((const char *)params->data(), sizeof(Params));
+		if (!write_network(*params, opts.output)) {
+			std::cerr << "failed to write " << opts.output << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "wrote " << opts.output << std::endl;
+}